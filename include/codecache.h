@@ -0,0 +1,74 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include "figmaparser.h"
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+/**
+ * @brief The CodeCache class is a persistent cache of generated elements and components.
+ *
+ * Entries are addressed by a key made of the SHA1 digests of the element content (see FigmaTree::contentHash)
+ * and the generation parameters, therefore a hit is always valid for the current document. Entries
+ * are kept serialized and decoded only on a hit. When the cache is saved, the least recently used
+ * entries are dropped to keep it under the size limit. Entries are found and inserted from the parser jobs.
+ */
+class CodeCache {
+public:
+    // image used by the generated code, these files are needed even the code is not generated
+    struct Image {
+        QString ref;
+        bool isRendering;
+    };
+    struct Entry {
+        std::shared_ptr<const FigmaParser::Element> element;
+        QVector<Image> images;
+    };
+    struct Stats {
+        unsigned hits = 0;
+        unsigned misses = 0;
+        unsigned evicted = 0;
+        int entries = 0;
+        qint64 size = 0;    // bytes
+    };
+    enum class Kind : char {Element = 'E', Component = 'C'};
+public:
+    static constexpr qint64 DefaultMaxSize = 64 * 1024 * 1024;
+    explicit CodeCache(qint64 maxSize = DefaultMaxSize);
+    /**
+     * Opens cache file and reads its entries, previous content is discarded.
+     * If file does not exist or is not compatible, the cache is empty
+     */
+    bool open(const QString& filename);
+    /**
+     * Writes entries to the file, if there are changes
+     */
+    bool save();
+    void close();
+    bool isOpen() const;
+    static QString cacheFileName(const QString& documentFile);
+    static QByteArray key(Kind kind, const QString& id, const QByteArray& contentHash, const QByteArray& generationKey);
+    std::optional<Entry> find(const QByteArray& key);
+    void insert(const QByteArray& key, const Entry& entry);
+    Stats stats() const;
+private:
+    struct Item {
+        QByteArray data;
+        quint64 lastUse;
+    };
+    void evict();
+private:
+    const qint64 m_maxSize;
+    mutable QMutex m_mutex;
+    QString m_filename;
+    QHash<QByteArray, Item> m_items;
+    qint64 m_size = 0;
+    quint64 m_useCount = 0;
+    bool m_dirty = false;
+    Stats m_stats;
+};
+
+#endif // CODECACHE_H
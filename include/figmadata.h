@@ -6,6 +6,7 @@
 #include <QDataStream>
 #include <QMutex>
 #include <tuple>
+#include <optional>
 
 //TODO: Change to QReadWriteLock - for perf?
 #define MUTEX_LOCK(m) QMutexLocker _l(&m);
@@ -89,7 +90,17 @@ public:
         m_data[key].state = State::Error;
     }
 
+    // data and format if committed, read at once as generation reads from other threads
+    std::optional<std::tuple<QByteArray, int>> committed(const QString& key) const {
+        MUTEX_LOCK(m_mutex);
+        const auto it = m_data.find(key);
+        if(it == m_data.end() || it->state != State::Committed)
+            return std::nullopt;
+        return std::make_tuple(it->data, it->format);
+    }
+
     void setBytes(const QString& key, const QByteArray& bytes, int meta =  0) {
+        MUTEX_LOCK(m_mutex);
         Q_ASSERT(m_data[key].state == State::Pending);
         m_data[key].data = bytes;
         m_data[key].format = meta;
@@ -110,6 +121,7 @@ public:
     }
 
     void clear(){
+        MUTEX_LOCK(m_mutex);
         m_data.clear();
     }
 
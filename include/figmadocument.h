@@ -38,6 +38,8 @@ public:
         }
 
         virtual bool addElement(const QString& name, const QByteArray& data) = 0;
+        // replaces data of an element, e.g. a placeholder when the element is generated
+        virtual bool setElement(int index, const QByteArray& data) = 0;
 
         int size() const {
             return static_cast<int>(m_elements.size());
@@ -95,6 +97,10 @@ public:
         return m_canvas[m_current].get();
     }
 
+    Canvas* getCanvas(int index) {
+        return m_canvas[index].get();
+    }
+
     void setCurrent(int index) {
         m_current = index;
     }
@@ -147,6 +153,12 @@ class FigmaFileDocument : public FigmaDocument {
                f.write(data);
                return true;
             }
+            bool write(const QByteArray& data) {
+               QFile f(m_data);
+               if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+                   return false;
+               return f.write(data) == data.size();
+            }
             QByteArray data() const override {return m_data;}
             QString name() const override {return m_name;}
         private:
@@ -163,6 +175,11 @@ class FigmaFileDocument : public FigmaDocument {
                  return false;
              return true;
          }
+        bool setElement(int index, const QByteArray& data) override {
+             Q_ASSERT(index >= 0 && index < size());
+             Q_ASSERT(!data.isEmpty());
+             return reinterpret_cast<ElementFile*>(m_elements[index].get())->write(data);
+         }
     private:
         const QString* m_directory;
     };
@@ -183,6 +200,8 @@ public:
         return m_components.contains(name);
      }
 
+     const QString& directory() const {return m_directory;}
+
      void addComponent(const QString& name, const QJsonObject& obj, const QByteArray& data) override {
          Q_UNUSED(obj);
          Q_UNUSED(data);
@@ -218,6 +237,12 @@ class FigmaDataDocument : public FigmaDocument {
              m_elements.push_back(std::make_unique<ElementData>(name, data));
              return true;
          }
+        bool setElement(int index, const QByteArray& data) override {
+             Q_ASSERT(index >= 0 && index < size());
+             Q_ASSERT(!data.isEmpty());
+             m_elements[index] = std::make_unique<ElementData>(m_elements[index]->name(), data);
+             return true;
+         }
     };
 public:
     static DocumentType type() {return DocumentType::DataDocument;}
@@ -225,10 +250,10 @@ public:
         Q_UNUSED(directory);
     }
 
+    // components are set as closures (see FigmaTree::componentClosure), hence no need to walk them here
     QStringList components(const QString& elementName) const {
-        QSet<QString> allComponents;
-        getComponents(allComponents, elementName);
-        QStringList lst = allComponents.values();
+        const auto allComponents = m_componentMap.value(elementName);
+        QStringList lst(allComponents.begin(), allComponents.end());
         lst.sort();
         return lst;
     }
@@ -324,15 +349,6 @@ public:
         return m_components[componentName].second;
     }
 
-private:
-    void getComponents(QSet<QString>& componentSet, const QString& elementName) const {
-        for(const QString& component : m_componentMap[elementName]) {
-            if(!componentSet.contains(component)){
-                componentSet.insert(component);
-                getComponents(componentSet, component);
-            }
-        }
-    }
 private:
     QHash<QString, QPair<QByteArray, QByteArray>> m_components;
 };
@@ -2,12 +2,15 @@
 #define FIGMAGET_H
 
 #include "figmaprovider.h"
+#include "ratelimiter.h"
 #include <QTime>
 #include <QMutex>
 #include <QTimer>
 #include <QQueue>
+#include <QSet>
 #include <QNetworkReply>
 #include <memory>
+#include <map>
 
 class FigmaData;
 class Downloads;
@@ -20,6 +23,8 @@ class FigmaGet : public FigmaProvider {
     Q_PROPERTY(QString userToken MEMBER m_userToken NOTIFY userTokenChanged)
     Q_PROPERTY(QString projectToken MEMBER m_projectToken NOTIFY projectTokenChanged)
     Q_PROPERTY(int throttle MEMBER m_throttle NOTIFY throttleChanged)
+    Q_PROPERTY(int apiRequests MEMBER m_apiRequests NOTIFY requestsChanged)
+    Q_PROPERTY(int imageRequests MEMBER m_imageRequests NOTIFY requestsChanged)
     using NetworkFunction = std::function <QNetworkReply* ()>;
 public:
     enum class IdType {IMAGE, RENDERING, NODE};
@@ -61,20 +66,30 @@ signals:
     void userTokenChanged();
     void updateCompleted(bool isUpdated);
     void throttleChanged();
-    void restored(unsigned flags, const QVariantMap& imports);
+    void requestsChanged();
+    void restored(unsigned flags, const QVariantMap& imports, const QString& filename);
     void replyComplete(const std::shared_ptr<QByteArray>& bytes);
 private:
     struct Id {
         bool isEmpty() const {return id.isEmpty();}
         const QString id; const IdType type;
     };
+    enum class Host {Api, Images};    // requests in flight are limited per host
+    enum class Endpoint {Files, Images, Nodes, Content}; // API requests are rate limited per class, content is image downloads
     using FinishedFunction = std::function<void ()>;
     void monitorReply(QNetworkReply* reply, const std::shared_ptr<QByteArray>& bytes,
                       const FinishedFunction& finalize, bool showProgress = true);
-    void queueCall(const NetworkFunction& call);
+    void queueCall(const NetworkFunction& call, Endpoint endpoint);
+    void delayCall(qint64 ms);
+    qint64 acquire(Endpoint endpoint);
+    void updateLimits(QNetworkReply* reply);
+    static Endpoint endpoint(const QUrl& url);
+    static Host host(Endpoint endpoint);
+    int maxRequests(Host host) const;
+    QNetworkRequest request(const QUrl& url, Host host) const;
     QByteArray image(const Id& imageRef, const QByteArray& imageData) const;
     bool write(QDataStream& stream, unsigned flag, const QVariantMap& imports) const;
-    bool read(QDataStream& stream);
+    bool read(QDataStream& stream, const QString& filename);
 private slots:
      void replyCompleted(const std::shared_ptr<QByteArray>& bytes);
      void doCall();
@@ -86,7 +101,8 @@ private slots:
 private:
     QNetworkReply* populateImages();
     QNetworkReply* doRequestRendering(const Id& id);
-    void doRetrieveNode(const Id& id);
+    QNetworkReply* doRetrieveNodes();
+    void failBatch(QNetworkReply* reply);
     QNetworkReply* doRetrieveImage(const Id& id,  FigmaData* target, const QSize& maxSize);
     void retrieveImage(const Id& id,  FigmaData* target, const QSize& maxSize = QSize(std::numeric_limits<int>::max(), std::numeric_limits<int>::max()));
     void requestRendering(const Id& imageId);
@@ -109,9 +125,22 @@ private:
     std::unique_ptr<FigmaData> m_nodes;
     std::atomic_bool m_populationOngoing = false;
     int m_throttle = 300; //Idea of throttle is collect requests into queue and bunches to reduce especially renderig requests
-    QQueue<NetworkFunction> m_callQueue;
+    int m_apiRequests = 4;      // in flight to the Figma API
+    int m_imageRequests = 8;    // in flight to the image server
+    struct Call {
+        NetworkFunction function;
+        Endpoint endpoint;
+    };
+    struct Calls {
+        QQueue<Call> queue;
+        int inFlight = 0;
+    };
+    std::map<Host, Calls> m_calls;
+    std::map<Endpoint, RateLimiter> m_limiters;
     QTimer m_callTimer;
     QStringList m_rendringQueue;
+    QStringList m_nodeQueue;
+    QSet<QString> m_singleNodes;    // ids of a failed batch, requested alone
     State m_connectionState = State::Loading;
     QMap<QNetworkReply*, std::tuple<std::shared_ptr<QByteArray>, FinishedFunction>> m_replies;
     std::function<void (const QString&)> m_lastError = nullptr;
@@ -0,0 +1,55 @@
+#ifndef FIGMAINDEX_H
+#define FIGMAINDEX_H
+
+#include <QHash>
+#include <QVector>
+#include <QJsonObject>
+#include <QString>
+#include <vector>
+
+/**
+ * @brief The FigmaIndex class is a flat index of Figma nodes.
+ *
+ * Nodes are stored in pre-order, i.e. a parent is always before its descendants, and
+ * can be looked up by id, by type or, for instances, by their component.
+ */
+class FigmaIndex {
+public:
+    struct Entry {
+        QString id;
+        QString type;       // as in Figma, e.g. "COMPONENT"
+        QJsonObject object;
+        int parent = -1;    // index of parent entry, -1 for roots
+        QVector<int> children;
+    };
+public:
+    FigmaIndex() = default;
+    explicit FigmaIndex(const QJsonObject& root) {add(root);}
+    /**
+     * Adds a root and its subtree, nodes already in index are not added again. Returns index of the root.
+     */
+    int add(const QJsonObject& root);
+    int indexOf(const QString& id) const {return m_ids.value(id, -1);}
+    bool contains(const QString& id) const {return m_ids.contains(id);}
+    const Entry& at(int index) const {return m_entries[static_cast<size_t>(index)];}
+    const Entry* entry(const QString& id) const {
+        const auto index = indexOf(id);
+        return index < 0 ? nullptr : &at(index);
+    }
+    QString parent(const QString& id) const {
+        const auto e = entry(id);
+        return e && e->parent >= 0 ? at(e->parent).id : QString();
+    }
+    const QVector<int>& ofType(const QString& type) const {return find(m_types, type);}
+    const QVector<int>& instances(const QString& componentId) const {return find(m_instances, componentId);}
+    int size() const {return static_cast<int>(m_entries.size());}
+private:
+    static const QVector<int>& find(const QHash<QString, QVector<int>>& hash, const QString& key);
+private:
+    std::vector<Entry> m_entries;
+    QHash<QString, int> m_ids;
+    QHash<QString, QVector<int>> m_types;
+    QHash<QString, QVector<int>> m_instances;
+};
+
+#endif // FIGMAINDEX_H
@@ -3,6 +3,7 @@
 
 #include "figmaprovider.h"
 #include "orderedmap.h"
+#include "parserarena.h"
 #include <QJsonDocument>
 #include <QRegularExpression>
 #include <QJsonArray>
@@ -14,9 +15,15 @@
 #include <QFont>
 #include <QColor>
 #include <optional>
+#include <array>
+#include <vector>
 
 constexpr auto FIGMA_SUFFIX{"_figma"};
 
+class FigmaTree;
+class FigmaIndex;
+class FileNames;
+
 /**
  * This class cries TODO!
  *
@@ -27,6 +34,10 @@ constexpr auto FIGMA_SUFFIX{"_figma"};
  * This should be rewritten to to tree (or other syntax independent container)
  * that can do quiries while parsing and then separate phase for code generation.
  *
+ * FigmaTree is the first step: the flag independent resolving (component lookups,
+ * instance deltas and children matching) is done there once per document and
+ * this class is left to the code generation.
+ *
  * Maitaining this is terrible as it requires terrible hacks and tricks whenever
  * changes are needed, state information accessed or maintainded :-/
  *
@@ -34,12 +45,10 @@ constexpr auto FIGMA_SUFFIX{"_figma"};
 
 
 class FigmaParser {
-private:
-    // this is set of contexts where a image is used
-    using ImageContexts =  QSet<QString>;
+    friend class FigmaTree;
+public:
     // Components as filename -> object + qml code
     using ComponentStreams = QHash<QByteArray, std::tuple<QJsonObject, QByteArray/*, QString*/>>;
-public:
     // Loader (for asLoader replacement) id --> obj + name
     using ExternalLoaders = QHash<QString, std::tuple<QByteArray, QString>>;
 public:
@@ -82,6 +91,7 @@ public:
         Element& operator=(const Element& other) = delete;
         const QString& id() const {return m_id;}
         const QString& name() const {return m_name;}
+        const QString& type() const {return m_type;}
         const QByteArray& data() const {return m_data;}
         const QStringList& components() const {return m_componentIds;}
         const QStringList& imageContexts() const {return m_imageContexts;}
@@ -113,7 +123,7 @@ public:
             m_name(name), m_id(id), m_key(key),
             m_description(description), m_object(object) {}
         QString name() const {
-            Q_ASSERT(m_name.endsWith(FIGMA_SUFFIX) || validFileName(m_name, false) == m_name);
+            Q_ASSERT(m_name.endsWith(FIGMA_SUFFIX) || makeFileName(m_name) == m_name);
             return m_name;
         }
         const QString& description() const {return m_description;}
@@ -129,6 +139,20 @@ public:
     };
     using Components = QHash<QString, std::shared_ptr<Component>>;
     using Canvases = std::vector<Canvas>;
+    /**
+     * @brief The Dependencies class, external data that has to be fetched before an element or component can be generated
+     */
+    struct Dependencies {
+        QSet<QString> images;
+        QSet<QString> renderings;
+        QSet<QString> fonts;
+        Dependencies& operator+=(const Dependencies& other) {
+            images.unite(other.images);
+            renderings.unite(other.renderings);
+            fonts.unite(other.fonts);
+            return *this;
+        }
+    };
 
 public:
     inline static const QString PlaceHolder = "placeholder";
@@ -150,25 +174,44 @@ public:
     };
     using EByteArray = std::optional<QByteArray>;
 public:
-    static std::optional<Components> components(const QJsonObject& project,  FigmaParserData& data);
+    static std::optional<Components> components(const QJsonObject& project, const FigmaIndex& index, FigmaParserData& data, FileNames& names);
     static std::optional<Canvases> canvases(const QJsonObject& project);
-    static std::optional<Element> component(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const Components& components);
-    static std::optional<Element> element(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const Components& components);
+    static std::optional<Element> component(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const FigmaTree& tree);
+    static std::optional<Element> element(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const FigmaTree& tree);
+    static FigmaIndex documentIndex(const QJsonObject& project);
+    static QStringList missingComponents(const QJsonObject& project, const FigmaIndex& index);
+    static std::optional<QHash<QString, QJsonObject>> componentObjects(const QJsonObject& project, const FigmaIndex& index, FigmaParserData& data);
+    static Dependencies dependencies(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const FigmaTree& tree);
     static QString name(const QJsonObject& project);
     static QString lastError();
+    static unsigned parsedNodes(); // total number of parse() calls, for benchmarking
     static QString makeFileName(const QString& itemName);
+    enum class ItemType {None, Vector, Text, Frame, Component, Boolean, Instance};
 private:
     enum class StrokeType {Normal, Double, OnePix};
-    enum class ItemType {None, Vector, Text, Frame, Component, Boolean, Instance};
+    // Figma "type" strings, decoded once per lookup instead of string comparisons
+    enum class NodeType {Unknown, Rectangle, Text, Component, BooleanOperation, Instance, Ellipse, Vector, Line,
+                         RegularPolygon, Star, Group, Frame, ComponentSet, Slice, Stamp, Sticky, ShapeWithText, None};
+    // Figma "constraints" values, horizontal and vertical use the same
+    enum class Constraint {Unknown, Min, Max, Center, Stretch, Scale};
+    enum class StrokeAlign {Center, Inside, Outside};
+    // properties that most generators read, decoded once per node and passed along
+    struct Fields {
+        NodeType type = NodeType::Unknown;
+        bool visible = true;
+        std::optional<double> opacity;
+        std::optional<std::array<double, 6>> transform; // relativeTransform, two rows
+        std::optional<QSizeF> size;
+        Constraint horizontal = Constraint::Min;
+        Constraint vertical = Constraint::Min;
+        bool hasStrokes = false;
+        std::optional<double> strokeWeight;
+        StrokeAlign strokeAlign = StrokeAlign::Center;
+    };
 private:
-    static QString validFileName(const QString& itemName, bool inited);
-    static QHash<QString, QJsonObject> getObjectsByType(const QJsonObject& obj, const QString& type);
-    static QJsonObject delta(const QJsonObject& instance, const QJsonObject& base,
-                             const QSet<QString>& ignored,
-                             const QHash<QString, std::function<QJsonValue (const QJsonValue&, const QJsonValue&)>>& compares);
     static QHash<QString, QString> children(const QJsonObject& obj);
     std::optional<Element> getElement(const QJsonObject& obj);
-    QString tabs(int indents) const;
+    QByteArray tabs(int indents) const;
 #if 0
     QRectF boundingRect(const QJsonObject& obj);
     QRectF boundingRect(const QString& svgPath, const QSizeF& size) const;
@@ -177,19 +220,19 @@ private:
     QByteArray makeId(const QJsonObject& obj);
     QByteArray makeId(const QString& prefix,  const QJsonObject& obj);
     EByteArray makeComponentInstance(const QString& type, const QJsonObject& obj, int indents, const QByteArray& change_receiver = QByteArray());
-    EByteArray makeItem(const QString& type, const QJsonObject& obj, int indents, const QByteArray& change_receiver = QByteArray());
+    EByteArray makeItem(const QString& type, const QJsonObject& obj, const Fields& fields, int indents, const QByteArray& change_receiver = QByteArray());
 
-    QPointF position(const QJsonObject& obj) const;
+    static QPointF position(const Fields& fields);
 
-    QByteArray makeExtents(const QJsonObject& obj, int indents, const QRectF& extents = QRectF{0, 0, 0, 0});
-    QByteArray makeSize(const QJsonObject& obj, int indents, const QSizeF& extents = QSizeF{0, 0});
+    QByteArray makeExtents(const QJsonObject& obj, const Fields& fields, int indents, const QRectF& extents = QRectF{0, 0, 0, 0});
+    QByteArray makeSize(const Fields& fields, int indents, const QSizeF& extents = QSizeF{0, 0});
     QByteArray makeColor(const QJsonObject& obj, int indents, double opacity = 1.);
     QByteArray makeEffects(const QJsonObject& obj, int indents);
-    QByteArray makeTransforms(const QJsonObject& obj, int indents);
+    QByteArray makeTransforms(const QJsonObject& obj, const Fields& fields, int indents);
     EByteArray makeImageSource(const QString& image, bool isRendering, int indents, const QString& placeHolder = QString());
     EByteArray makeImageRef(const QString& image, int indents);
     EByteArray makeFill(const QJsonObject& obj, int indents);
-    EByteArray makeVector(const QJsonObject& obj, int indents);
+    EByteArray makeVector(const QJsonObject& obj, const Fields& fields, int indents);
     QByteArray makeStrokeJoin(const QJsonObject& stroke, int indent);
     QByteArray makeShapeStroke(const QJsonObject& obj, int indents, StrokeType type = StrokeType::Normal);
     QByteArray makeShapeFill(const QJsonObject& obj, int indents);
@@ -197,6 +240,7 @@ private:
     QByteArray makeSvgPath(int index, bool isFill, const QString& pathId, const QJsonObject& obj, int indents);
 
     EByteArray parse(const QJsonObject& obj, int indents);
+    void collectDependencies(const QJsonObject& obj, Dependencies& dependencies) const;
 
     bool isGradient(const QJsonObject& obj) const;
 
@@ -211,15 +255,15 @@ private:
       * to if-else hell and wrote open to keep normal/inside/outside and image/fill
       * cases managed
     */
-     EByteArray makeVectorNormalFill(const QJsonObject& obj, int indents);
-     EByteArray makeVectorNormalFill(const QString& image, const QJsonObject& obj, int indents);
-     EByteArray makeVectorNormal(const QJsonObject& obj, int indents);
-     EByteArray makeVectorInsideFill(const QJsonObject& obj, int indents);
-     EByteArray makeVectorInsideFill(const QString& image, const QJsonObject& obj, int indents);
-     EByteArray makeVectorInside(const QJsonObject& obj, int indentsBase);
-     EByteArray makeVectorOutsideFill(const QJsonObject& obj, int indents);
-     EByteArray makeVectorOutsideFill(const QString& image, const QJsonObject& obj, int indents);
-     EByteArray makeVectorOutside(const QJsonObject& obj, int indentsBase);
+     EByteArray makeVectorNormalFill(const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorNormalFill(const QString& image, const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorNormal(const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorInsideFill(const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorInsideFill(const QString& image, const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorInside(const QJsonObject& obj, const Fields& fields, int indentsBase);
+     EByteArray makeVectorOutsideFill(const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorOutsideFill(const QString& image, const QJsonObject& obj, const Fields& fields, int indents);
+     EByteArray makeVectorOutside(const QJsonObject& obj, const Fields& fields, int indentsBase);
 
      EByteArray parseVector(const QJsonObject& obj, int indents);
 
@@ -250,6 +294,9 @@ private:
      EByteArray parseContainer(const QJsonObject& obj, Content content, int indents);
 
      EByteArray makeInstanceChildren(const QJsonObject& obj, const QJsonObject& comp, int indents);
+     bool instanceChildrenMatched(const QJsonObject& obj, const QJsonObject& comp) const;
+     QJsonObject instanceChildDelta(const QJsonObject& obj, int componentChild) const;
+     static bool isGeometryDelta(const QJsonObject& delta);
      QJsonValue getValue(const QJsonObject& obj, const QString& key) const;
 
      EByteArray parseInstance(const QJsonObject& obj, int indents);
@@ -274,50 +321,46 @@ private:
      QByteArray addComponentStream(const QJsonObject& obj,  const QByteArray& child_item);
      QByteArray makePropertyChangeHandler(int indents);
      EByteArray makeComponentPropertyChangeHandler(const QJsonObject& obj, int indents, const QByteArray& change_receiver);
-     QString makeFileName(const QJsonObject& obj, const QString& prefix) const;
-     ~FigmaParser();
+     static QString makeFileName(const QJsonObject& obj, const QString& prefix, const QByteArray& content, int variant);
      std::tuple<QByteArray, QString> makePathAlias(int pathIndex, const QJsonObject& obj, int indents);
 private:
-     struct Parent{
-         const QJsonObject* obj;
-         const Parent* parent;
-         QSet<QString> ids;
+     // Stack of the objects being parsed
+     class Scope {
+     public:
+         explicit Scope(std::pmr::memory_resource* resource) : m_frames(resource) {}
+         void push(const QJsonObject& obj) {m_frames.push_back(&obj);}
+         void pop() {Q_ASSERT(!m_frames.empty()); m_frames.pop_back();}
+         int depth() const {return static_cast<int>(m_frames.size());}
+         const QJsonObject& object() const {Q_ASSERT(!m_frames.empty()); return *m_frames.back();}
          template<typename T>
-         auto operator[](const T& k) const {return (*obj)[k];}
-         void push(const QJsonObject* obj_) {
-             parent = new Parent{obj, parent, {}};
-             obj = obj_;
-         }
-         void pop() {
-             Q_ASSERT(parent);
-             obj = parent->obj;
-             auto p = parent;
-             parent = p->parent;
-             ids += p->ids;
-             delete p;
-         }
+         auto operator[](const T& k) const {return object()[k];}
+     private:
+         std::pmr::vector<const QJsonObject*> m_frames;
      };
      struct Alias {
          QString id;
          QJsonObject obj;
      };
  private:
-    FigmaParser(unsigned flags, FigmaParserData& data, const Components* components);
+    FigmaParser(unsigned flags, FigmaParserData& data, const FigmaTree* tree);
     bool isQul() const {return m_flags & QulMode;}
     bool generateAccess() const {return (m_flags & StaticCode) == 0;}
 private:
     const unsigned m_flags;
     FigmaParserData& m_data;
-    const Components* m_components;
-    const QString m_indent = "    ";
-    QSet<QString> m_componentIds;
-    Parent m_parent;
-    ImageContexts m_imageContext;
-    QVector<Alias> m_aliases;
+    const FigmaTree* m_tree;
+    ParserArena m_arena;    // per run scratch data, released at once
+    std::pmr::vector<QString> m_componentIds;   // may have duplicates
+    Scope m_scope;
+    std::pmr::vector<QString> m_imageContext;   // may have duplicates
+    std::pmr::vector<Alias> m_aliases;
     int m_componentLevel = 0;
     ComponentStreams m_componentStreams;
     static QByteArray fontWeight(double v);
-    static std::optional<FigmaParser::ItemType> type(const QJsonObject& obj);
+    static NodeType nodeType(const QJsonObject& obj);
+    static std::optional<FigmaParser::ItemType> itemType(NodeType type);
+    static Constraint constraint(const QString& value);
+    static Fields fields(const QJsonObject& obj);
     ExternalLoaders m_externalLoaders;
 };
 
@@ -24,6 +24,7 @@ signals:
     void imageReady(const QString& imageRef, const QByteArray& bytes, int format);
     void renderingReady(const QString& figmaId, const QByteArray& bytes, int format);
     void nodeReady(const QString& figmaId);
+    void imageFailed(const QString& imageRef); // image or rendering cannot be retrieved
 };
 
 
@@ -34,7 +35,6 @@ public:
     virtual QByteArray nodeData(const QString&) = 0;
     virtual QString fontInfo(const QString&) = 0;
     virtual QString qmlTargetDir() const = 0;
-    virtual unsigned unique_number() = 0;
 };
 
 
@@ -4,12 +4,21 @@
 #include "figmadocument.h"
 #include "figmaprovider.h"
 #include "figmaparser.h"
+#include "figmatree.h"
+#include "codecache.h"
 #include <QObject>
 #include <QVariantMap>
 #include <QUrl>
 #include <QVector>
+#include <QMutex>
+#include <QThread>
+#include <QPointer>
 #include <memory>
 #include <optional>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <set>
 
 class FigmaFileDocument;
 class FigmaDataDocument;
@@ -32,6 +41,7 @@ class FigmaQml : public QObject, public FigmaParserData {
     Q_PROPERTY(QString elementName READ elementName NOTIFY elementNameChanged)
     Q_PROPERTY(QString documentName READ documentName NOTIFY documentNameChanged)
     Q_PROPERTY(int imageDimensionMax MEMBER m_imageDimensionMax NOTIFY imageDimensionMaxChanged)
+    Q_PROPERTY(int jobs MEMBER m_jobs NOTIFY jobsChanged)
     Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
     Q_PROPERTY(bool isValid READ isValid NOTIFY isValidChanged)
     Q_PROPERTY(QString qmlDir READ qmlDir CONSTANT)
@@ -59,6 +69,7 @@ public:
         KeepFigmaFontName           = 0x80000,
         LoaderPlaceHolders          = 0x100000,
         RenderLoaderPlaceHolders    = 0x200000,
+        ProgressiveImages           = 0x400000,
     };
     Q_ENUM(Flags)
 public:
@@ -66,7 +77,6 @@ public:
      QByteArray imageData(const QString&, bool isRendering) override;
      QByteArray nodeData(const QString&) override;
      QString fontInfo(const QString&) override;
-     unsigned unique_number() override;
 public:
     FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvider& provider, QObject* parent = nullptr);
     ~FigmaQml();
@@ -91,7 +101,8 @@ public:
     bool setBrokenPlaceholder(const QString& placeholder);
     bool isValid() const;
     void setFilter(const QMap<int, QSet<int>>& filter);
-    void restore(int flags, const QVariantMap& imports);
+    bool isPending(int canvas_index, int element_index) const;
+    void restore(int flags, const QVariantMap& imports, const QString& filename = QString());
     QString documentsLocation() const;
     QVariantList elements() const;
     const auto& externalLoaders() const {return m_externalLoaders;}
@@ -150,6 +161,7 @@ signals:
     void canvasNameChanged();
     void elementNameChanged();
     void imageDimensionMaxChanged();
+    void jobsChanged();
     void documentNameChanged();
     void busyChanged();
     void isValidChanged();
@@ -179,30 +191,91 @@ private slots:
     void applyExternalLoaders();
 private:
     void addImageFile(const QString& imageRef, bool isRendering);
+    QByteArray placeholder(const QString& imageRef);
+    void awaitImages(const QString& id, const QStringList& imageRefs);
+    void imageArrived(const QString& imageRef);
+    void imageFailed(const QString& imageRef);
+    void dropPlaceholders();
+    void removeQmlFile(const QString& component_name);
     bool addImageFileData(const QString& imageRef, const QByteArray& bytes, int mime);
     bool ensureDirExists(const QString& dirname) const;
-    bool doCreateDocument(FigmaDocument& doc, const QJsonObject& json);
-    template<class FigmaDocType>
-    void createDocument(const QJsonObject& json);
+    using Documents = std::vector<FigmaDocument*>;
+    bool doCreateDocument(const Documents& docs, const QJsonObject& json);
+    void createDocument(const QJsonObject& json, bool withView, int firstCanvas = 0, int firstElement = 0);
+    void runGeneration(const QJsonObject& json, const std::function<bool ()>& generate, const std::function<bool (bool)>& apply, const std::function<void ()>& failed);
+    void stopGeneration();
+    void update(const std::function<void ()>& f);
+    void update(const FigmaDocument* doc, const std::function<void ()>& f);
+    void applyUpdates();
+    void generatePending(const QJsonObject& json);
+    QMap<int, QSet<int>> nextPass() const;
+    bool patchDocument();
+    bool isGenerated() const;
+    bool isSelected(int canvas, int element) const;
+    const FigmaTree* documentTree(const QJsonObject& json);
+    int requestDependencies(const QJsonObject& json);
     std::optional<QJsonObject> object(const QByteArray& bytes);
     void cleanDir(const QString& dirName);
+    void removeViewDir(const QString& dirName);
     std::optional<std::tuple<QByteArray, int>> getImage(const QString& imageRef, bool isRendering);
     void suspend();
-    bool writeComponents(FigmaDocument& doc, const FigmaParser::Components& components, const QByteArray& header);
-    bool setDocument(FigmaDocument& doc, const FigmaParser::Canvases& canvases, const FigmaParser::Components& components, const QByteArray& header);
+    void runInMainThread(const std::function<void ()>& f);
+    template<typename F>
+    void forEachJob(int count, const F& f);
+    bool writeComponents(const Documents& docs, const FigmaTree& tree, const QByteArray& header);
+    bool setDocument(const Documents& docs, const FigmaTree& tree, const QByteArray& header, bool patch = false);
+    void setTreeSource(const QByteArray& data);
+    std::optional<QJsonObject> project(const QByteArray& data);
+    const FigmaIndex& documentIndex(const QJsonObject& json);
+    struct Generated {
+        QByteArray hash;    // FigmaTree::contentHash
+        std::shared_ptr<const FigmaParser::Element> element;
+    };
+    struct GenerationCache {
+        QHash<QString, Generated> components;
+        QHash<QString, Generated> elements;
+    };
+    QByteArray generationKey(const QByteArray& header) const;
+    QSet<QString> requiredComponents(const FigmaTree& tree) const;
+    static QStringList usedComponents(const QStringList& componentIds, const FigmaTree& tree, const QHash<QString, Generated>& cache, const FigmaParser::Element& element);
+    static std::shared_ptr<const FigmaParser::Element> cached(const QHash<QString, Generated>& cache, const QString& id, const FigmaTree& tree);
+    std::shared_ptr<const FigmaParser::Element> storedCode(CodeCache::Kind kind, const QString& id, const FigmaTree& tree);
+    void storeCode(CodeCache::Kind kind, const QString& id, const FigmaTree& tree, const std::shared_ptr<const FigmaParser::Element>& element, const QVector<CodeCache::Image>& images);
+    void saveCodeCache();
     QString qmlTargetDir() const override;
     std::optional<QString> uniqueFilename(const QString& filename, const QByteArray& data);
 private:
     const QString m_qmlDir;
+    QString m_targetDir;                    // view and sources are written here, see createDocumentView
     FigmaProvider& mProvider;
     std::unique_ptr<FigmaFileDocument> m_uiDoc;
     std::unique_ptr<FigmaDataDocument> m_sourceDoc;
     QVariantMap m_imports;
     int m_imageDimensionMax = 1024;
+    int m_jobs = 0; // 0 is QThread::idealThreadCount
     bool m_busy = false;
     unsigned m_flags = 0;
     QByteArray m_brokenPlaceholder;
     QMap<int, QSet<int>> m_filter;
+    struct Parameters {                     // values a generation uses, copied before the worker starts
+        unsigned flags = 0;
+        QByteArray header;
+        QMap<int, QSet<int>> filter;
+        int imageDimensionMax = 1024;
+        std::shared_ptr<FontCache> fonts;
+    };
+    Parameters m_params;
+    QMap<int, QSet<int>> m_pass;            // elements of the ongoing generation pass as in filter, empty is all
+    std::set<std::pair<int, int>> m_pending; // (canvas, element) that are placeholders, see generatePending
+    unsigned m_revision = 0;                // of the document, passes of a replaced document are dropped
+    bool m_patching = false;                // background passes are ongoing
+    bool m_progressive = false;             // images are patched in as they arrive, see ProgressiveImages
+    QPointer<QThread> m_worker;             // generation is run in a worker thread, see runGeneration
+    bool m_generating = false;              // worker is on, changes to the shown state wait for it
+    QMutex m_updateMutex;
+    std::vector<std::function<void ()>> m_updates; // changes to the shown state, see update
+    QHash<QString, QSet<QString>> m_awaited; // image -> elements and components that have its placeholder
+    QSet<QString> m_staleComponents;        // to be written again as their images have arrived
     QHash<QString, QPair<QString, QString>> m_imageFiles;
     QString m_snap;
     std::unique_ptr<FontCache> m_fontCache;
@@ -211,13 +284,22 @@ private:
     std::atomic_bool m_ok = true;
     bool m_embedImages = false;
     enum class State {Constructing, Failed, Suspend};
-    State m_state = State::Constructing;
+    std::atomic<State> m_state = State::Constructing;
     std::function<void (bool)> mRestore = nullptr;
     QHash<QString, QSet<QString>> m_imageContexts;
     FontInfo* m_fontInfo;
     FigmaParser::ExternalLoaders m_externalLoaders;
-    unsigned m_unique_number = 1;
-    QHash<QString, quint16> m_crcs;
+    QHash<QString, quint16> m_crcs;        // written files, guarded by m_crcMutex
+    mutable QMutex m_crcMutex;
+    QSet<QString> m_requested;
+    mutable QMutex m_imageMutex;
+    std::map<QByteArray, GenerationCache> m_generated; // per generationKey
+    QByteArray m_generationKey;
+    CodeCache m_codeCache;  // generated code over sessions, next to the restored file
+    std::optional<FigmaTree> m_tree;
+    std::optional<FigmaIndex> m_index; // document index until the tree is built, then tree has it
+    std::optional<QJsonObject> m_project;
+    QByteArray m_treeSource;
 };
 
 
@@ -0,0 +1,93 @@
+#ifndef FIGMATREE_H
+#define FIGMATREE_H
+
+#include "figmaparser.h"
+#include "figmaindex.h"
+#include "filenames.h"
+#include <QHash>
+#include <QVector>
+#include <QJsonObject>
+#include <QSet>
+#include <QStringList>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief The FigmaTree class is a syntax independent view of a Figma document.
+ *
+ * It is built once per document and holds everything that does not depend on the code generation
+ * flags: the resolved components (fetched nodes included), canvases, node index and the instance
+ * resolution (instance vs. component deltas and matching of instance children). FigmaParser only
+ * generates code over it, therefore changing flags, imports or image sizes does not redo those.
+ */
+class FigmaTree {
+public:
+    // per index entry data, the structure (object, type, parent and children) is in the index
+    struct Node {
+        size_t hash = 0;        // subtree content
+        size_t properties = 0;  // own properties that are alike between instances, see isVarying
+        // instance resolution, only for instances which component is known
+        QString componentId;
+        QJsonObject instanceDelta;          // instance vs. component, children ignored
+        QVector<int> childIndices;          // per component child an index of matching instance child, -1 if not found
+        QVector<QJsonObject> childDeltas;   // per component child its delta to the matching instance child
+    };
+public:
+    /**
+     * Builds the tree, index is the document index (see FigmaParser::documentIndex), fetched components are added to it
+     */
+    static std::optional<FigmaTree> build(const QJsonObject& project, FigmaIndex&& index, FigmaParserData& data);
+    const QString& name() const {return m_name;}
+    const FigmaParser::Components& components() const {return m_components;}
+    const FigmaParser::Canvases& canvases() const {return m_canvases;}
+    const FigmaIndex& index() const {return m_index;}
+    const Node* node(const QString& id) const {
+        const auto index = m_index.indexOf(id);
+        return index < 0 ? nullptr : &m_nodes[static_cast<size_t>(index)];
+    }
+    QString elementName(const QString& id) const {return m_names.name(id);}
+    /**
+     * Content digest (SHA1) of an element or component, if equal between trees the generated code is equal too
+     */
+    QByteArray contentHash(const QString& id) const {return m_contentHashes.value(id);}
+    int size() const {return m_index.size();}
+    /**
+     * Components in dependency order, a component is always after the components it uses
+     */
+    const QStringList& componentOrder() const {return m_componentOrder;}
+    /**
+     * Ids of the components that an element or component uses, directly or indirectly, itself excluded
+     */
+    const QStringList& componentClosure(const QString& id) const;
+private:
+    FigmaTree(const QString& name, FigmaIndex&& index);
+    void makeHashes();
+    void collectComponentIds(int index, QSet<QString>& ids) const;
+    QStringList directDependencies(int index) const;
+    void makeDependencies();
+    void orderComponent(const QString& id, QSet<QString>& visited);
+    QByteArray makeContentHash(const QString& id, QSet<QString>& visiting);
+    void resolveInstance(int index);
+    QJsonObject delta(int instance, int base, const QSet<QString>& ignored);
+    size_t childrenHash(int index) const;
+    static bool isVarying(const QString& key);
+    static bool sameProperties(const QJsonObject& a, const QJsonObject& b);
+private:
+    QString m_name;
+    FigmaIndex m_index;
+    std::vector<Node> m_nodes;  // parallel to index entries
+    FigmaParser::Components m_components;
+    FigmaParser::Canvases m_canvases;
+    FileNames m_names;  // of the elements and components
+    QHash<QString, QByteArray> m_contentHashes;
+    QHash<QString, QStringList> m_dependencies;   // element or component -> components it uses directly
+    QHash<QString, QStringList> m_closures;       // element or component -> components it uses
+    QStringList m_componentOrder;
+    struct Delta {
+        QJsonObject instance;   // the delta is of its non-varying keys
+        QJsonObject delta;
+    };
+    QMultiHash<std::pair<int, size_t>, Delta> m_deltas; // (base, hash of instance properties) -> deltas
+};
+
+#endif // FIGMATREE_H
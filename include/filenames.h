@@ -0,0 +1,29 @@
+#ifndef FILENAMES_H
+#define FILENAMES_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+/**
+ * @brief The FileNames class gives the elements and components of a document unique file names.
+ *
+ * A name is bound to a node id. Names are given when the document tree is built, components in id
+ * order and elements in document order, therefore the same document always gets the same names
+ * regardless of the earlier documents or the generation order. After that the names are only read,
+ * and that is safe from the parser jobs.
+ */
+class FileNames {
+public:
+    /**
+     * Name for a node, a node asked again gets the same name
+     */
+    QString add(const QString& id, const QString& itemName);
+    QString name(const QString& id) const {return m_names.value(id);}
+private:
+    QHash<QString, QString> m_names;    // id -> file name
+    QHash<QString, int> m_counts;       // item name -> times used
+    QSet<QString> m_used;               // file names given
+};
+
+#endif // FILENAMES_H
@@ -22,6 +22,7 @@ public:
     }
 
     QString operator[](const QString& key) const {
+        QMutexLocker lock(&m_mutex);
         return m_fontMap[key];
     }
 
@@ -0,0 +1,50 @@
+#ifndef JSONSCANNER_H
+#define JSONSCANNER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <functional>
+#include <initializer_list>
+#include <optional>
+
+/**
+ * @brief The JsonScanner class reads values from raw JSON without building a document.
+ *
+ * Values are returned as views into the scanned buffer and only the parts that are
+ * walked are looked at, i.e. a key lookup skips over the other members without
+ * decoding them. The buffer must outlive the views.
+ */
+class JsonScanner {
+public:
+    using Value = QByteArrayView;
+    explicit JsonScanner(const QByteArray& data) : m_data(data) {}
+    bool isValid() const {
+        const auto root = find({});
+        return root && isObject(*root);
+    }
+    /**
+     * Returns a value of the given key path from the root object, nullopt if not found or invalid.
+     */
+    std::optional<Value> find(std::initializer_list<QByteArrayView> path) const;
+    /**
+     * Calls f for each key (raw, without quotes) and value in the object, f returns false to stop.
+     * Returns false if the value is not a valid object.
+     */
+    static bool forEachMember(Value object, const std::function<bool (Value key, Value value)>& f);
+    static bool isObject(Value value) {return !value.isEmpty() && value.front() == '{';}
+    static bool isString(Value value) {return value.size() >= 2 && value.front() == '"';}
+    static bool toBool(Value value) {return value == QByteArrayView("true");}
+    /**
+     * Returns a string value unescaped, null string if not a string.
+     */
+    static QString toString(Value value);
+private:
+    static qsizetype skipSpace(Value data, qsizetype pos);
+    static qsizetype skipValue(Value data, qsizetype pos);
+    static qsizetype skipString(Value data, qsizetype pos);
+private:
+    const QByteArray m_data;
+};
+
+#endif // JSONSCANNER_H
@@ -0,0 +1,50 @@
+#ifndef PARSERARENA_H
+#define PARSERARENA_H
+
+#include <memory_resource>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief The ParserArena class is a monotonic memory pool for the scratch data of a FigmaParser run.
+ *
+ * Nothing is released before the parser is destroyed and then all at once. The first block is
+ * inline, bigger elements take more blocks from the heap. Served allocations and heap blocks are
+ * counted for the benchmark (--timed) output. Only the container storage comes from here, the Qt
+ * strings and byte arrays stored in the containers allocate their data as usual.
+ */
+class ParserArena : public std::pmr::memory_resource {
+public:
+    ParserArena() : m_pool(m_buffer, sizeof(m_buffer), &m_upstream) {}
+    ParserArena(const ParserArena&) = delete;
+    ParserArena& operator=(const ParserArena&) = delete;
+    static unsigned allocations() {return s_allocations;}          // total, served from arenas
+    static unsigned heapAllocations() {return s_heapAllocations;}  // total, blocks arenas took from the heap
+private:
+    class Upstream : public std::pmr::memory_resource {
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            ++s_heapAllocations;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {return this == &other;}
+    };
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++s_allocations;
+        return m_pool.allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        m_pool.deallocate(p, bytes, alignment); // no-op, monotonic
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {return this == &other;}
+private:
+    alignas(std::max_align_t) std::byte m_buffer[4096];
+    Upstream m_upstream;
+    std::pmr::monotonic_buffer_resource m_pool;
+    inline static std::atomic<unsigned> s_allocations{0};
+    inline static std::atomic<unsigned> s_heapAllocations{0};
+};
+
+#endif // PARSERARENA_H
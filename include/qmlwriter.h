@@ -0,0 +1,57 @@
+#ifndef QMLWRITER_H
+#define QMLWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <array>
+#include <charconv>
+
+/**
+ * @brief The QmlWriter class appends generated QML into a byte array.
+ *
+ * Indentation is precomputed and numbers are formatted directly as ASCII, so a
+ * property line is written without QString temporaries or UTF-16 conversions.
+ */
+class QmlWriter {
+public:
+    explicit QmlWriter(QByteArray& out) : m_out(out) {}
+    // indentation as shared byte arrays, deeper ones are made on demand
+    static QByteArray indentation(int indents) {
+        constexpr auto Cached = 32;
+        static const auto cache = [](){
+            std::array<QByteArray, Cached> tabs;
+            for(auto i = 1; i < Cached; ++i)
+                tabs[i] = tabs[i - 1] + "    ";
+            return tabs;
+        }();
+        if(indents <= 0)
+            return QByteArray();
+        return indents < Cached ? cache[indents] : QByteArray("    ").repeated(indents);
+    }
+    QmlWriter& indent(int indents) {m_out += indentation(indents); return *this;}
+    QmlWriter& operator<<(const char* str) {m_out += str; return *this;}
+    QmlWriter& operator<<(char c) {m_out += c; return *this;}
+    QmlWriter& operator<<(const QByteArray& bytes) {m_out += bytes; return *this;}
+    QmlWriter& operator<<(const QString& str) {m_out += str.toUtf8(); return *this;}
+    QmlWriter& operator<<(int value) {
+        std::array<char, 16> buffer;
+        const auto res = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+        m_out.append(buffer.data(), static_cast<qsizetype>(res.ptr - buffer.data()));
+        return *this;
+    }
+    QmlWriter& operator<<(double value) {m_out += QByteArray::number(value, 'g', 6); return *this;}
+    // hex of at least two digits, e.g. for colors
+    QmlWriter& hex(unsigned value) {
+        constexpr char digits[] = "0123456789abcdef";
+        int shift = 4;
+        while(shift < 28 && (value >> (shift + 4)) != 0)
+            shift += 4;
+        for(; shift >= 0; shift -= 4)
+            m_out += digits[(value >> shift) & 0xF];
+        return *this;
+    }
+private:
+    QByteArray& m_out;
+};
+
+#endif // QMLWRITER_H
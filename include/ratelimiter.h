@@ -0,0 +1,52 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QtGlobal>
+#include <chrono>
+#include <optional>
+
+/**
+ * @brief The RateLimiter class is a token bucket that adapts to the server limits.
+ *
+ * Tokens are refilled at the current rate up to the burst size and each request takes one. When the server
+ * says there are too many requests, the rate is halved and requests are held back for the time the server
+ * asks (Retry-After) or an exponential delay, both with jitter so that retries do not come at once.
+ * Successful requests ramp the rate back up to the nominal rate.
+ */
+class RateLimiter {
+    using Clock = std::chrono::steady_clock;
+public:
+    /**
+     * rate is requests per second, burst is the number of requests that can be sent at once
+     */
+    explicit RateLimiter(double rate = 1.0, double burst = 5.0);
+    /**
+     * Takes a token and returns 0 if a request can be sent now, otherwise milliseconds to wait
+     */
+    qint64 acquire();
+    /**
+     * Returns the token, when there was nothing to send after all
+     */
+    void refund();
+    /**
+     * Server refused with too many requests, retryAfter is milliseconds if the server told
+     */
+    void backOff(std::optional<qint64> retryAfter);
+    /**
+     * Request was served, remaining and reset (milliseconds) are from the rate limit headers, if any
+     */
+    void succeeded(std::optional<int> remaining = std::nullopt, std::optional<qint64> reset = std::nullopt);
+    double rate() const {return m_rate;}
+private:
+    void refill(Clock::time_point now);
+private:
+    const double m_nominalRate;
+    const double m_burst;
+    double m_rate;
+    double m_tokens;
+    unsigned m_failures = 0;
+    Clock::time_point m_refilled;
+    Clock::time_point m_blockedUntil;
+};
+
+#endif // RATELIMITER_H
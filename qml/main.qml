@@ -406,6 +406,16 @@ ApplicationWindow {
                                     figmaQml.flags &= ~FigmaQml.StaticCode
                             }
                         }
+                        QtCheckBox {
+                            text: "Progressive images"
+                            checked: figmaQml.flags & FigmaQml.ProgressiveImages
+                            onCheckedChanged: {
+                                if(checked)
+                                    figmaQml.flags |= FigmaQml.ProgressiveImages
+                                else
+                                    figmaQml.flags &= ~FigmaQml.ProgressiveImages
+                            }
+                        }
                         QtCheckBox {
                             text: "Cyan background"
                             checked: false
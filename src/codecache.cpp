@@ -0,0 +1,208 @@
+#include "codecache.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QMutexLocker>
+#include <algorithm>
+
+constexpr auto CacheStreamId{"FigmaQML code cache"};
+constexpr quint32 CacheVersion{3};
+
+static void writeElement(QDataStream& stream, const CodeCache::Entry& entry) {
+    const auto& element = *entry.element;
+    stream << element.name() << element.id() << element.type() << element.data()
+           << element.components() << element.imageContexts() << element.aliases();
+    const auto& streams = element.subComponents();
+    stream << static_cast<quint32>(streams.size());
+    for(auto it = streams.begin(); it != streams.end(); ++it)
+        stream << it.key() << std::get<QJsonObject>(*it) << std::get<QByteArray>(*it);
+    const auto& loaders = element.externalLoaders();
+    stream << static_cast<quint32>(loaders.size());
+    for(auto it = loaders.begin(); it != loaders.end(); ++it)
+        stream << it.key() << std::get<QByteArray>(*it) << std::get<QString>(*it);
+    stream << static_cast<quint32>(entry.images.size());
+    for(const auto& image : entry.images)
+        stream << image.ref << image.isRendering;
+}
+
+static std::optional<CodeCache::Entry> readElement(QDataStream& stream) {
+    QString name, id, type;
+    QByteArray data;
+    QStringList componentIds, contexts;
+    QVector<QString> aliases;
+    stream >> name >> id >> type >> data >> componentIds >> contexts >> aliases;
+    quint32 count;
+    stream >> count;
+    FigmaParser::ComponentStreams streams;
+    for(auto i = 0U; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QByteArray key, code;
+        QJsonObject obj;
+        stream >> key >> obj >> code;
+        streams.insert(key, {obj, code});
+    }
+    stream >> count;
+    FigmaParser::ExternalLoaders loaders;
+    for(auto i = 0U; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString key, loaderName;
+        QByteArray loader;
+        stream >> key >> loader >> loaderName;
+        loaders.insert(key, {loader, loaderName});
+    }
+    stream >> count;
+    QVector<CodeCache::Image> images;
+    for(auto i = 0U; i < count && stream.status() == QDataStream::Ok; ++i) {
+        CodeCache::Image image;
+        stream >> image.ref >> image.isRendering;
+        images.append(image);
+    }
+    if(stream.status() != QDataStream::Ok)
+        return std::nullopt;
+    return CodeCache::Entry{std::make_shared<const FigmaParser::Element>(name, id, type, std::move(data),
+                                                                        std::move(componentIds), std::move(contexts), std::move(aliases),
+                                                                        streams, loaders),
+                            std::move(images)};
+}
+
+CodeCache::CodeCache(qint64 maxSize) : m_maxSize(maxSize) {}
+
+QString CodeCache::cacheFileName(const QString& documentFile) {
+    const QFileInfo info(documentFile);
+    return info.dir().filePath(info.completeBaseName() + ".figmaqmlcache");
+}
+
+QByteArray CodeCache::key(Kind kind, const QString& id, const QByteArray& contentHash, const QByteArray& generationKey) {
+    return static_cast<char>(kind) + id.toUtf8() + ':' + contentHash.toHex()
+            + ':' + generationKey.toHex();
+}
+
+bool CodeCache::open(const QString& filename) {
+    QMutexLocker lock(&m_mutex);
+    m_filename = filename;
+    m_items.clear();
+    m_size = 0;
+    m_useCount = 0;
+    m_dirty = false;
+    m_stats = {};
+    QFile file(filename);
+    if(!file.exists())
+        return true;
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&file);
+    QString streamId;
+    quint32 version, qtVersion;
+    stream >> streamId >> version >> qtVersion;
+    // hashes are Qt's, hence a different version may not match
+    if(streamId != QLatin1String(CacheStreamId) || version != CacheVersion || qtVersion != QT_VERSION)
+        return true;
+    quint32 count;
+    stream >> m_useCount >> count;
+    for(auto i = 0U; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QByteArray key;
+        Item item;
+        stream >> key >> item.lastUse >> item.data;
+        m_size += item.data.size();
+        m_items.insert(key, item);
+    }
+    if(stream.status() != QDataStream::Ok) {
+        m_items.clear();
+        m_size = 0;
+        return false;
+    }
+    return true;
+}
+
+bool CodeCache::isOpen() const {
+    QMutexLocker lock(&m_mutex);
+    return !m_filename.isEmpty();
+}
+
+void CodeCache::close() {
+    QMutexLocker lock(&m_mutex);
+    m_filename.clear();
+    m_items.clear();
+    m_size = 0;
+    m_dirty = false;
+}
+
+bool CodeCache::save() {
+    QMutexLocker lock(&m_mutex);
+    if(m_filename.isEmpty() || !m_dirty)
+        return true;
+    evict();
+    QSaveFile file(m_filename);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&file);
+    stream << QString(CacheStreamId) << CacheVersion << static_cast<quint32>(QT_VERSION);
+    stream << m_useCount << static_cast<quint32>(m_items.size());
+    for(auto it = m_items.begin(); it != m_items.end(); ++it)
+        stream << it.key() << it->lastUse << it->data;
+    if(stream.status() != QDataStream::Ok || !file.commit())
+        return false;
+    m_dirty = false;
+    return true;
+}
+
+// least recently used are removed until the size fits
+void CodeCache::evict() {
+    if(m_size <= m_maxSize)
+        return;
+    std::vector<std::pair<quint64, QByteArray>> uses;
+    uses.reserve(static_cast<size_t>(m_items.size()));
+    for(auto it = m_items.begin(); it != m_items.end(); ++it)
+        uses.emplace_back(it->lastUse, it.key());
+    std::sort(uses.begin(), uses.end());
+    for(const auto& [lastUse, key] : uses) {
+        if(m_size <= m_maxSize)
+            break;
+        m_size -= m_items[key].data.size();
+        m_items.remove(key);
+        ++m_stats.evicted;
+    }
+}
+
+std::optional<CodeCache::Entry> CodeCache::find(const QByteArray& key) {
+    QMutexLocker lock(&m_mutex);
+    const auto it = m_items.find(key);
+    if(it == m_items.end()) {
+        ++m_stats.misses;
+        return std::nullopt;
+    }
+    QDataStream stream(it->data);
+    auto entry = readElement(stream);
+    if(!entry) {
+        m_size -= it->data.size();
+        m_items.erase(it);
+        ++m_stats.misses;
+        return std::nullopt;
+    }
+    it->lastUse = ++m_useCount;
+    m_dirty = true;
+    ++m_stats.hits;
+    return entry;
+}
+
+void CodeCache::insert(const QByteArray& key, const Entry& entry) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    writeElement(stream, entry);
+    QMutexLocker lock(&m_mutex);
+    if(m_filename.isEmpty())
+        return;
+    if(const auto it = m_items.find(key); it != m_items.end())
+        m_size -= it->data.size();
+    m_size += data.size();
+    m_items.insert(key, {data, ++m_useCount});
+    m_dirty = true;
+}
+
+CodeCache::Stats CodeCache::stats() const {
+    QMutexLocker lock(&m_mutex);
+    auto stats = m_stats;
+    stats.entries = static_cast<int>(m_items.size());
+    stats.size = m_size;
+    return stats;
+}
@@ -3,6 +3,7 @@
 #include "functorslot.h"
 #include "downloads.h"
 #include "utils.h"
+#include "jsonscanner.h"
 #include <QQmlEngine>
 #include <QNetworkReply>
 #include <QJsonDocument>
@@ -13,7 +14,13 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QAbstractEventDispatcher>
+#include <QDateTime>
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+#include <QHttp1Configuration>
+#endif
 #include <memory>
+#include <algorithm>
+#include <set>
 
 
 #include <QThread>
@@ -25,12 +32,67 @@ constexpr auto TIMEOUT_ERR = "%1 timeout \"%2\"";
 
 constexpr auto TimeoutTime = 60 * 1000;
 
-constexpr auto ImageRetry = 60 * 1000;
+constexpr auto ApiHost = "api.figma.com";
+
+constexpr auto MaxUrlLength = 4000; // servers commonly accept 8k, there is no need to go near
+
+constexpr auto BatchIds = "figmaIds"; // reply property, ids a batched request has
 
 enum Format {
     None = 0, JPEG, PNG
 };
 
+// Retry-After is either seconds or an HTTP date
+static std::optional<qint64> retryAfter(const QNetworkReply* reply) {
+    const auto value = reply->rawHeader("Retry-After").trimmed();
+    if(value.isEmpty())
+        return std::nullopt;
+    bool ok;
+    const auto seconds = value.toLongLong(&ok);
+    if(ok)
+        return seconds * 1000;
+    const auto date = QDateTime::fromString(QString::fromLatin1(value), Qt::RFC2822Date);
+    if(date.isValid())
+        return std::max<qint64>(0, QDateTime::currentDateTimeUtc().msecsTo(date));
+    return std::nullopt;
+}
+
+// ids that fit into room (URL characters) are taken from the queue, at least one, an id in alone is taken by itself
+static QStringList takeBatch(QStringList& queue, int room, const QSet<QString>& alone = {}) {
+    QStringList ids;
+    int length = 0;
+    while(!queue.isEmpty()) {
+        if(alone.contains(queue.first())) {
+            if(ids.isEmpty())
+                ids.append(queue.takeFirst());
+            break;
+        }
+        const auto idLength = QUrl::toPercentEncoding(queue.first()).length() + (ids.isEmpty() ? 0 : 1);
+        if(!ids.isEmpty() && length + idLength > room)
+            break;
+        length += idLength;
+        ids.append(queue.takeFirst());
+    }
+    return ids;
+}
+
+static std::optional<qint64> headerNumber(const QNetworkReply* reply, std::initializer_list<const char*> names) {
+    for(const auto name : names) {
+        bool ok;
+        const auto value = reply->rawHeader(name).trimmed().toLongLong(&ok);
+        if(ok)
+            return value;
+    }
+    return std::nullopt;
+}
+
+// error status of a response, a string unquoted or a number as is
+static QString statusText(const std::optional<JsonScanner::Value>& status) {
+    if(!status)
+        return QString();
+    return JsonScanner::isString(*status) ? JsonScanner::toString(*status) : QString::fromUtf8(status->toByteArray());
+}
+
 const QLatin1String StreamId("FQ03");
 
 // otherwise id can conflict
@@ -38,6 +100,10 @@ QString asTimeoutId(const QString& id) {
     return id + "_timeout";
 }
 
+QString fromTimeoutId(const QString& id) {
+    return id.endsWith(QLatin1String("_timeout")) ? id.chopped(8) : id;
+}
+
 #ifdef Q_ASSERT
 static QSet<QString> FetchFailedDebug;
 #endif
@@ -64,6 +130,12 @@ FigmaGet::FigmaGet(QObject *parent) : FigmaProvider(parent),
          m_checksum = 0;
      });
 
+     // nominal rates (requests per second) and bursts, these adapt to what the server says
+     m_limiters.emplace(Endpoint::Files, RateLimiter(1.0, 3.0));
+     m_limiters.emplace(Endpoint::Images, RateLimiter(1.0, 5.0));
+     m_limiters.emplace(Endpoint::Nodes, RateLimiter(3.0, 10.0));
+
+     m_callTimer.setSingleShot(true);
      QObject::connect(&m_callTimer, &QTimer::timeout, this, &FigmaGet::doCall, Qt::QueuedConnection);
 
      QObject::connect(this, &FigmaGet::error, [this](const QString&) {
@@ -105,6 +177,7 @@ void FigmaGet::onRetrievedImage(const QString& imageRef) {
             FetchFailedDebug.insert(imageRef);
 #endif
             m_images->setError(imageRef);
+            emit imageFailed(imageRef);
             emit error(QString("Image cannot be retrieved \"%1\"").arg(imageRef));
         }
     }
@@ -113,15 +186,17 @@ void FigmaGet::onRetrievedImage(const QString& imageRef) {
             emit renderingReady(imageRef, m_renderings->data(imageRef), m_renderings->format(imageRef));
         } else {
             m_renderings->setError(imageRef);
+            emit imageFailed(imageRef);
             emit error(QString("Rendering cannot be retrieved \"%1\"").arg(imageRef));
         }
     }
 }
 
 void FigmaGet::onRetrievedNode(const QString& nodeId) {
-
+     if(!m_nodes->contains(nodeId))
+         return; // reset meanwhile
      if(!m_nodes->isEmpty(nodeId)) {
-         emit nodeReady(m_nodes->data(nodeId));
+         emit nodeReady(nodeId);
      } else {
          m_nodes->setError(nodeId);
          emit error(QString("Node cannot be retrieved \"%1\"").arg(nodeId));
@@ -130,11 +205,13 @@ void FigmaGet::onRetrievedNode(const QString& nodeId) {
 
 bool FigmaGet::isReady() {
 
-    return m_callQueue.isEmpty() && m_timeout->pending() == 0;
+    return std::all_of(m_calls.begin(), m_calls.end(), [](const auto& calls) {return calls.second.queue.isEmpty();})
+            && m_timeout->pending() == 0;
 }
 
 void FigmaGet::doFinished(QNetworkReply* rep)
 {
+    updateLimits(rep);
     if(rep->error() == QNetworkReply::NoError) { // error handled after this
         auto& reply_data = m_replies[rep];
         auto data = std::get<std::shared_ptr<QByteArray>>(reply_data);
@@ -150,7 +227,7 @@ void FigmaGet::retrieveImage(const Id& id,  FigmaData* target, const QSize& maxS
     Q_ASSERT(maxSize.width() > 0 && maxSize.height() > 0);
     queueCall([this, id, target, maxSize]() {
         return doRetrieveImage(id, target, maxSize);
-    });
+    }, Endpoint::Content);
 }
 
  void FigmaGet::requestRendering(const Id& imageId) {
@@ -160,16 +237,17 @@ void FigmaGet::retrieveImage(const Id& id,  FigmaData* target, const QSize& maxS
      }
      queueCall([this, imageId](){
          return FigmaGet::doRequestRendering(imageId);
-     });
+     }, Endpoint::Images);
  }
 
 
 
+// nodes are requested in batches as renderings, each id has a call but the first one takes all that fit
 void FigmaGet::retrieveNode(const Id& id) {
-     queueCall([this, id]() {
-         doRetrieveNode(id);
-         return nullptr;
-     });
+     m_nodeQueue.append(id.id);
+     queueCall([this]() {
+         return doRetrieveNodes();
+     }, Endpoint::Nodes);
  }
 
 bool FigmaGet::store(const QString& filename, unsigned flags, const QVariantMap& imports) {
@@ -202,7 +280,7 @@ bool FigmaGet::restore(const QString& filename) {
 #endif
     if(file.open(QIODevice::ReadOnly)) {
         QDataStream stream(&file);
-        if(!read(stream)) {
+        if(!read(stream, filename)) {
             emit error("Restore failed on " + filename);
             return false;
         }
@@ -233,7 +311,7 @@ bool FigmaGet::write(QDataStream& stream, unsigned flags, const QVariantMap& imp
     return stream.status() == QDataStream::Ok;
 }
 
-bool FigmaGet::read(QDataStream& stream) {
+bool FigmaGet::read(QDataStream& stream, const QString& filename) {
 
     reset();
     QString streamid;
@@ -257,7 +335,7 @@ bool FigmaGet::read(QDataStream& stream) {
     m_renderings->read(stream);
     m_nodes->read(stream);
 
-    emit restored(flags, imports);
+    emit restored(flags, imports, filename);
     return stream.status() == QDataStream::Ok;
 }
 
@@ -268,9 +346,13 @@ void FigmaGet::reset() {
     m_images->clear();
     m_renderings->clear();
     m_nodes->clear();
-    m_callQueue.clear();
+    for(auto& calls : m_calls)
+        calls.second.queue.clear(); // ones in flight are still counted until they are gone
     m_rendringQueue.clear();
+    m_nodeQueue.clear();
+    m_singleNodes.clear();
     m_replies.clear();
+    m_populationOngoing = false;
     m_lastError = nullptr;
 }
 
@@ -284,22 +366,46 @@ void FigmaGet::cancel() {
     m_downloads->cancel();
 }
 
+// queued calls are sent as long as their host has room and their endpoint has budget, the rest when
+// earlier requests are done or the budget allows, calls of an endpoint are sent in order
 void FigmaGet::doCall() {
-    if(m_callQueue.isEmpty()) {
-
-        m_callTimer.stop();
-    }
-    else {
-
-        const auto call = m_callQueue.dequeue();
-        auto reply = call();
-        m_downloads->monitor(reply, call);
+    for(auto it = m_calls.begin(); it != m_calls.end(); ++it) {
+        const auto host = it->first;
+        auto& calls = it->second;
+        std::set<Endpoint> limited;
+        for(int i = 0; i < calls.queue.size() && calls.inFlight < maxRequests(host);) {
+            const auto endpoint = calls.queue[i].endpoint;
+            if(limited.count(endpoint) > 0) {
+                ++i;
+                continue;
+            }
+            if(const auto wait = acquire(endpoint); wait > 0) {
+                limited.insert(endpoint);
+                delayCall(wait);
+                ++i;
+                continue;
+            }
+            const auto call = calls.queue.takeAt(i).function;
+            auto reply = call();
+            if(!reply) { // nothing to request, e.g. rendering went in an earlier bunch
+                if(const auto limiter = m_limiters.find(endpoint); limiter != m_limiters.end())
+                    limiter->second.refund();
+                continue;
+            }
+            ++calls.inFlight;
+            QObject::connect(reply, &QObject::destroyed, this, [this, host]() {
+                --m_calls[host].inFlight;
+                if(!m_calls[host].queue.isEmpty())
+                    QMetaObject::invokeMethod(this, &FigmaGet::doCall, Qt::QueuedConnection);
+            });
+            m_downloads->monitor(reply, call);
+        }
     }
 }
 
-void FigmaGet::queueCall(const NetworkFunction& call) {
+void FigmaGet::queueCall(const NetworkFunction& call, Endpoint endpoint) {
 
-    m_callQueue.enqueue(call);
+    m_calls[host(endpoint)].queue.enqueue({call, endpoint});
 #ifndef NO_THROTTLED_CALL
     if(!m_callTimer.isActive()) {
         m_callTimer.start(m_throttle);
@@ -309,6 +415,71 @@ void FigmaGet::queueCall(const NetworkFunction& call) {
 #endif
 }
 
+void FigmaGet::delayCall(qint64 ms) {
+    if(!m_callTimer.isActive() || m_callTimer.remainingTime() > ms)
+        m_callTimer.start(static_cast<int>(ms));
+}
+
+// 0 if a request can be sent now, otherwise milliseconds to wait
+qint64 FigmaGet::acquire(Endpoint endpoint) {
+    const auto it = m_limiters.find(endpoint);
+    return it != m_limiters.end() ? it->second.acquire() : 0;
+}
+
+// limits adapt to responses, see RateLimiter
+void FigmaGet::updateLimits(QNetworkReply* reply) {
+    const auto it = m_limiters.find(endpoint(reply->url()));
+    if(it == m_limiters.end())
+        return;
+    const auto statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    if(statusCode.isValid() && statusCode.toInt() == 429) {
+        it->second.backOff(retryAfter(reply));
+        return;
+    }
+    if(reply->error() != QNetworkReply::NoError)
+        return;
+    const auto remaining = headerNumber(reply, {"X-RateLimit-Remaining", "RateLimit-Remaining"});
+    auto reset = headerNumber(reply, {"X-RateLimit-Reset", "RateLimit-Reset"});
+    if(reset) // seconds, either to the reset or since the epoch
+        reset = *reset > 1000000000 ? std::max<qint64>(0, *reset * 1000 - QDateTime::currentMSecsSinceEpoch()) : *reset * 1000;
+    it->second.succeeded(remaining ? std::make_optional(static_cast<int>(*remaining)) : std::nullopt, reset);
+}
+
+FigmaGet::Endpoint FigmaGet::endpoint(const QUrl& url) {
+    if(url.host() != QLatin1String(ApiHost))
+        return Endpoint::Content;
+    const auto path = url.path();
+    if(path.startsWith(QLatin1String("/v1/images/")))
+        return Endpoint::Images;
+    if(path.endsWith(QLatin1String("/nodes")))
+        return Endpoint::Nodes;
+    return Endpoint::Files;
+}
+
+FigmaGet::Host FigmaGet::host(Endpoint endpoint) {
+    return endpoint == Endpoint::Content ? Host::Images : Host::Api;
+}
+
+int FigmaGet::maxRequests(Host host) const {
+    return std::max(1, host == Host::Api ? m_apiRequests : m_imageRequests);
+}
+
+// HTTP/2 multiplexes requests over a connection when the server supports it,
+// otherwise the keep-alive connections are reused
+QNetworkRequest FigmaGet::request(const QUrl& url, Host host) const {
+    QNetworkRequest request(url);
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+    QHttp1Configuration http1;
+    http1.setNumberOfConnectionsPerHost(static_cast<qsizetype>(maxRequests(host)));
+    request.setHttp1Configuration(http1);
+#else
+    Q_UNUSED(host);
+#endif
+    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+    return request;
+}
+
 QByteArray FigmaGet::data() const {
 
     return m_data;
@@ -330,6 +501,8 @@ void FigmaGet::setError(const Id& imageRef, const QString& reason) {
         type = "Node";
         break;
     }
+    if(imageRef.type != IdType::NODE)
+        emit imageFailed(fromTimeoutId(imageRef.id));
     emit error(QString(reason).arg(type, imageRef.id));
 }
 
@@ -379,8 +552,10 @@ void FigmaGet::getImage(const QString& imageRef, const QSize& maxSize) {
                 setError({imageRef, IdType::IMAGE}, NOT_FOUND_ERR);
             }
         });
-        if(!m_populationOngoing) //just wait population
-            populateImages();
+        if(!m_populationOngoing) { //just wait population
+            m_populationOngoing = true;
+            queueCall([this]() {return populateImages();}, Endpoint::Files);
+        }
         return;
     }
 
@@ -400,9 +575,6 @@ void FigmaGet::getImage(const QString& imageRef, const QSize& maxSize) {
 
 QNetworkReply* FigmaGet::doRetrieveImage(const Id& id, FigmaData *target, const QSize &maxSize) {
     Q_ASSERT(FetchFailedDebug.find(id.id) == FetchFailedDebug.end());
-    QNetworkRequest request;
-    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
-    request.setAttribute(QNetworkRequest::SynchronousRequestAttribute, false);
     const QUrl uri = target->url(id.id);
 
     qDebug() << "doRetrieveImage" << enumToString(id.type) << id.id << id.isEmpty() << uri;
@@ -412,8 +584,8 @@ QNetworkReply* FigmaGet::doRetrieveImage(const Id& id, FigmaData *target, const
         return nullptr;
     }
 
-    request.setUrl(uri);
-    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+    auto request = this->request(uri, host(endpoint(uri)));
+    request.setAttribute(QNetworkRequest::SynchronousRequestAttribute, false);
     auto reply = m_accessManager->get(request);
 
     std::shared_ptr<QByteArray> bytes(new QByteArray);
@@ -472,11 +644,7 @@ QNetworkReply* FigmaGet::populateImages() {
 
     m_populationOngoing = true;
 
-    QNetworkRequest request;
-    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
-
-    request.setUrl(QUrl("https://api.figma.com/v1/files/" + m_projectToken + "/images"));
-    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+    const auto request = this->request(QUrl("https://api.figma.com/v1/files/" + m_projectToken + "/images"), Host::Api);
 
     auto reply = m_accessManager->get(request);
 
@@ -490,29 +658,30 @@ QNetworkReply* FigmaGet::populateImages() {
            emit error("Error on populate - no data");
            return;
         }
-        QJsonParseError err;
-        const auto doc = QJsonDocument::fromJson(*bytes, &err);
-        if(err.error != QJsonParseError::NoError) {
-               emit error(QString("Error on populate - JSON: %1 at %2")
-                        .arg(err.errorString())
-                        .arg(err.offset));
+        // response can be big, hence only the image URLs are read and no document is built
+        const JsonScanner json(*bytes);
+        if(!json.isValid()) {
+            emit error(QString("Error on populate - JSON: object expected"));
             //qDebug() << "Json - size:" << bytes->size() << "dump: " << *bytes;
             return;
         }
-        const auto obj = doc.object();
-        if(obj.contains("err")) {
-            Q_ASSERT(0); // todo
-        }
-        else if(obj["error"].toBool()) {
-            emit error(QString("Error on populate %1").arg(obj["status"].toString()));
+        const auto isError = json.find({"error"});
+        if(isError && JsonScanner::toBool(*isError)) {
+            const auto status = json.find({"status"});
+            emit error(QString("Error on populate %1").arg(statusText(status)));
         } else {
-            const auto meta = obj["meta"].toObject();
-            const auto images = meta["images"].toObject();
-            for(const auto& key : images.keys()) {
+            const auto images = json.find({"meta", "images"});
+            const auto ok = images && JsonScanner::forEachMember(*images, [this](auto k, auto v) {
+                const auto key = QString::fromUtf8(k);
                 if(!m_images->contains(key)) {
                     m_images->insert(key);
-                    m_images->setUrl(key, images[key].toString());
+                    m_images->setUrl(key, JsonScanner::toString(v));
                 }
+                return true;
+            });
+            if(!ok) {
+                emit error(QString("Error on populate - JSON: invalid images"));
+                return;
             }
         }
         emit imagesPopulated();
@@ -570,20 +739,14 @@ QNetworkReply* FigmaGet::doRequestRendering(const Id& id) {
     if(m_rendringQueue.isEmpty())
         return nullptr;
 
-    QNetworkRequest request;
-    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
-
-    const QStringList params{
-        "ids=" + m_rendringQueue.join(','),
-        "use_absolute_bounds=true"
-    };
-    m_rendringQueue.clear();
+    const auto url = "https://api.figma.com/v1/images/" + m_projectToken + "?use_absolute_bounds=true&ids=";
+    const auto ids = takeBatch(m_rendringQueue, MaxUrlLength - url.length()); // rest are requested when this is done
 
-    request.setUrl(QUrl("https://api.figma.com/v1/images/" + m_projectToken + "?" + params.join('&')));
-    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+    auto request = this->request(QUrl(url + ids.join(',')), Host::Api);
     request.setHeader(QNetworkRequest::ContentLengthHeader, 0);
 
     auto reply = m_accessManager->get(request);
+    reply->setProperty(BatchIds, ids);
     std::shared_ptr<QByteArray> bytes(new QByteArray);
 
 
@@ -603,27 +766,28 @@ QNetworkReply* FigmaGet::doRequestRendering(const Id& id) {
            setError(id, "%1 \"%2\" Error - no data");
            return;
         }
-        QJsonParseError err;
-        const auto doc = QJsonDocument::fromJson(*bytes, &err);
-        if(err.error != QJsonParseError::NoError) {
-           setError(id, "%1 \"%2\"" + QString("Error on rendering - JSON: %1 at %2")
-                    .arg(err.errorString(), err.offset));
+        const JsonScanner json(*bytes);
+        if(!json.isValid()) {
+           setError(id, "%1 \"%2\"" + QString("Error on rendering - JSON: object expected"));
             // this has bug in MSVC qDebug() << "JSON - size:" << bytes->size() << "dump: " << (bytes ? *bytes : "N/A");
             return;
         }
-        const auto obj = doc.object();
-        if(obj["error"].toBool()) {
-            setError(id, "%1 \"%2\"" + QString("Status %1").arg(obj["status"].toString()));
-        } else {
-            const auto renderings = obj["images"].toObject();
-            for(const auto& key : renderings.keys()) {
-                if(renderings[key].toString().isEmpty()) {
+        const auto isError = json.find({"error"});
+        if(isError && JsonScanner::toBool(*isError)) {
+            const auto status = json.find({"status"});
+            setError(id, "%1 \"%2\"" + QString("Status %1").arg(statusText(status)));
+        } else if(const auto renderings = json.find({"images"}); renderings) {
+            JsonScanner::forEachMember(*renderings, [this, &id](auto k, auto v) {
+                const auto key = QString::fromUtf8(k);
+                const auto url = JsonScanner::toString(v);
+                if(url.isEmpty()) {
                     setError(id, "%1 \"%2\"" + QString("Invalid URL key:\"%1\"").arg(key));
-                    break;
+                    return false;
                 }
-                m_renderings->setUrl(key, renderings[key].toString());
+                m_renderings->setUrl(key, url);
                 emit imageRendered(key);
-            }
+                return true;
+            });
         }
     };
     setTimeout(reply, id);
@@ -654,14 +818,15 @@ void FigmaGet::update() {
         return;
     }
 
-    QNetworkRequest request;
-    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
+    if(acquire(Endpoint::Files) > 0) { // updates are polled, hence this is just skipped
+        emit updateCompleted(false);
+        return;
+    }
 
     const QStringList params{
         {"geometry=paths"}
     };
-    request.setUrl(QUrl("https://api.figma.com/v1/files/" + m_projectToken + QChar('?') + params.join('&')));
-    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+    const auto request = this->request(QUrl("https://api.figma.com/v1/files/" + m_projectToken + QChar('?') + params.join('&')), Host::Api);
 
     std::shared_ptr<QByteArray> bytes(new QByteArray);
     auto reply = m_accessManager->get(request);
@@ -684,48 +849,66 @@ void FigmaGet::documentCreated() {
 
 void FigmaGet::getNode(const QString &id) {
 
-    if(!m_nodes->contains(id)) {
-        const QStringList params{
-            "ids=" + id,
-            "geometry=paths"
-        };
+    if(!m_nodes->contains(id))
         m_nodes->insert(id);
-        m_nodes->setUrl(id, "https://api.figma.com/v1/files/" + m_projectToken + "/nodes?" + params.join('&'));
-    }
 
     if(!m_nodes->isEmpty(id)) {
-        emit nodeReady(m_nodes->data(id));
+        emit nodeReady(id);
         return;
     }
 
-    if(m_nodes->setPending(id))
+    if(m_nodes->isError(id) || !m_nodes->setPending(id))
         return; // already on its way
 
     retrieveNode({id, IdType::NODE});
 }
 
-void FigmaGet::doRetrieveNode(const Id& id) {
+QNetworkReply* FigmaGet::doRetrieveNodes() {
 
+    if(m_nodeQueue.isEmpty())
+        return nullptr; // went in an earlier batch
 
-    QNetworkRequest request;
-    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
-
-    const auto uri = m_nodes->url(id.id);
-    request.setUrl(uri);
-    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+    const auto url = "https://api.figma.com/v1/files/" + m_projectToken + "/nodes?geometry=paths&ids=";
+    const auto ids = takeBatch(m_nodeQueue, MaxUrlLength - url.length(), m_singleNodes);
+    for(const auto& id : ids)
+        m_singleNodes.remove(id);
+    const auto request = this->request(QUrl(url + ids.join(',')), Host::Api);
 
     auto reply = m_accessManager->get(request);
+    reply->setProperty(BatchIds, ids);
 
     std::shared_ptr<QByteArray> bytes(new QByteArray);
 
-    const auto finished = [this, bytes, id] () {
-        if(m_connectionState == State::Loading)
-            m_nodes->setBytes(id.id, *bytes);
-        emit nodeRetrieved(id.id);
+    // response has all the batched nodes, each is stored as a response of its own
+    const auto finished = [this, bytes, ids] () {
+        const auto response = QJsonDocument::fromJson(*bytes).object();
+        const auto nodes = response["nodes"].toObject();
+        for(const auto& id : ids) {
+            if(!m_nodes->contains(id))
+                continue;
+            const auto node = nodes[id];
+            if(m_connectionState == State::Loading && node.isObject()) {
+                const QJsonObject single{{"nodes", QJsonObject{{id, node}}}};
+                m_nodes->setBytes(id, QJsonDocument(single).toJson(QJsonDocument::Compact));
+            }
+            emit nodeRetrieved(id);
+        }
     };
 
-    setTimeout(reply, id);
+    // one timeout for the batch, all its nodes fail with it
+    const auto batch = ids.join(',');
+    auto connection = std::make_shared<QMetaObject::Connection>();
+    *connection = QObject::connect(reply, &QNetworkReply::finished, this, [batch, this](){
+        m_timeout->cancel(batch);
+    });
+    m_timeout->set(batch, TimeoutTime, [this, ids, connection]() {
+        if(connection.use_count() > 1) {
+            for(const auto& id : ids)
+                setError({id, IdType::NODE}, TIMEOUT_ERR);
+        }
+    });
     monitorReply(reply, bytes, finished);
+    return reply;
 }
 
 
@@ -753,14 +936,22 @@ void FigmaGet::onReplyError(QNetworkReply::NetworkError err) {
     if(err == QNetworkReply::UnknownContentError || err == QNetworkReply::ProtocolInvalidOperationError) { //Too Many Requests
         const auto statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
         const auto code = statusCode.isValid() ? statusCode.toInt() : -1;
-        if(code == 429 || code == 400) {
+        if(code == 429) {
             emit m_downloads->tooManyRequests();
+            // limiter has backed off (see updateLimits) and holds it until the server allows, updates are just polled again
             const auto failedCall = m_downloads->monitored(reply);
-            QTimer::singleShot(ImageRetry, this, [this, failedCall]() { //figma doc says about one minute
-                queueCall(failedCall);
-            });
+            const auto failedEndpoint = endpoint(reply->url());
+            // batch is taken from its queue when sent, hence its ids are put back
+            const auto ids = reply->property(BatchIds).toStringList();
+            if(failedEndpoint == Endpoint::Nodes)
+                m_nodeQueue = ids + m_nodeQueue;
+            else if(failedEndpoint == Endpoint::Images)
+                m_rendringQueue = ids + m_rendringQueue;
+            if(failedCall)
+                queueCall(failedCall, failedEndpoint);
         }  else {
             emit error("HTTP error: " + reply->errorString());
+            failBatch(reply);
         }
     } else {
         const auto statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
@@ -769,10 +960,30 @@ void FigmaGet::onReplyError(QNetworkReply::NetworkError err) {
                 << reply->request().url()
                 << reply->request().rawHeaderList()
                  << statusCode;
+        failBatch(reply);
     }
     m_replies.remove(reply);
 }
 
+// a bad id fails the whole batch, hence its ids are retried one by one and only a node that fails
+// by itself is an error (see onRetrievedNode), otherwise they would be pending forever
+void FigmaGet::failBatch(QNetworkReply* reply) {
+    if(endpoint(reply->url()) != Endpoint::Nodes)
+        return;
+    const auto ids = reply->property(BatchIds).toStringList();
+    if(ids.size() == 1) {
+        emit nodeRetrieved(ids.first());
+        return;
+    }
+    m_nodeQueue = ids + m_nodeQueue;
+    for(const auto& id : ids) {
+        m_singleNodes.insert(id);
+        queueCall([this]() {
+            return doRetrieveNodes();
+        }, Endpoint::Nodes);
+    }
+}
+
 void FigmaGet::monitorReply(QNetworkReply* reply,
                             const std::shared_ptr<QByteArray>& bytes,
                             const std::function<void ()>& finalize,
@@ -805,26 +1016,18 @@ Downloads* FigmaGet::downloadProgress() {
 }
 
 
+// these are called from the generation threads, hence each entry is read at once
 std::optional<std::tuple<QByteArray, int>> FigmaGet::cachedImage(const QString& imageRef) {
-    if(!m_images->contains(imageRef) ||
-            m_images->isEmpty(imageRef) ||
-            m_images->isPending(imageRef))
-        return std::nullopt;
-    return std::make_optional(std::make_tuple(m_images->data(imageRef), m_images->format(imageRef)));
+    return m_images->committed(imageRef);
 }
 
 std::optional<std::tuple<QByteArray, int>> FigmaGet::cachedRendering(const QString& figmaId) {
-    if(!m_renderings->contains(figmaId) ||
-            m_renderings->isEmpty(figmaId) ||
-            m_renderings->isPending(figmaId))
-        return std::nullopt;
-    return std::make_optional(std::make_tuple(m_renderings->data(figmaId), m_renderings->format(figmaId)));
+    return m_renderings->committed(figmaId);
 }
 
 std::optional<QByteArray> FigmaGet::cachedNode(const QString& figmaId) {
-    if(!m_nodes->contains(figmaId) ||
-            m_nodes->isEmpty(figmaId) ||
-            m_nodes->isPending(figmaId))
+    const auto node = m_nodes->committed(figmaId);
+    if(!node)
         return std::nullopt;
-    return std::make_optional(m_nodes->data(figmaId));
+    return std::get<QByteArray>(*node);
 }
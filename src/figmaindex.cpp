@@ -0,0 +1,38 @@
+#include "figmaindex.h"
+#include <QJsonArray>
+#include <QStack>
+
+int FigmaIndex::add(const QJsonObject& root) {
+    const auto rootId = root["id"].toString();
+    if(const auto it = m_ids.find(rootId); it != m_ids.end())
+        return *it;
+    const auto rootIndex = size();
+    // iterative to keep pre-order without recursion, children are pushed in reverse to pop them in order
+    QStack<QPair<QJsonObject, int>> stack;
+    stack.push({root, -1});
+    while(!stack.isEmpty()) {
+        const auto [obj, parent] = stack.pop();
+        const auto id = obj["id"].toString();
+        if(m_ids.contains(id))
+            continue;
+        const auto index = size();
+        Entry entry{id, obj["type"].toString(), obj, parent, {}};
+        m_ids.insert(id, index);
+        m_types[entry.type].append(index);
+        if(entry.type == QLatin1String("INSTANCE"))
+            m_instances[obj["componentId"].toString()].append(index);
+        if(parent >= 0)
+            m_entries[static_cast<size_t>(parent)].children.append(index);
+        m_entries.push_back(std::move(entry));
+        const auto children = obj["children"].toArray();
+        for(auto i = children.size() - 1; i >= 0; --i)
+            stack.push({children[i].toObject(), index});
+    }
+    return rootIndex;
+}
+
+const QVector<int>& FigmaIndex::find(const QHash<QString, QVector<int>>& hash, const QString& key) {
+    static const QVector<int> empty;
+    const auto it = hash.find(key);
+    return it == hash.end() ? empty : *it;
+}
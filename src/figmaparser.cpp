@@ -1,6 +1,9 @@
 
 #include "figmaparser.h"
+#include "figmatree.h"
 #include "utils.h"
+#include "qmlwriter.h"
+#include "filenames.h"
 #include <QJsonDocument>
 #include <QRegularExpression>
 #include <QJsonArray>
@@ -11,11 +14,15 @@
 #include <QStack>
 #include <QFont>
 #include <QColor>
+#include <QCryptographicHash>
 #include <optional>
 #include <cmath>
+#include <algorithm>
 
 #include <QFile>
 #include <QTimer>
+#include <QMutex>
+#include <atomic>
 
 #ifndef M_PI
     #define M_PI 3.14159265358979323846
@@ -28,15 +35,28 @@ const auto AS_LOADER = "asLoader";
 const auto ID_PREFIX = "figma_";
 const auto SVGPATH_PREFIX = "svgpath_";
 
+// parsers can run concurrently, hence the error is guarded
+static QMutex& last_parse_error_mutex() {
+    static QMutex mutex;
+    return mutex;
+}
+
 static auto& last_parse_error() {
     static QString last_error_string;
     return last_error_string;
 }
 
+static void set_last_parse_error(const QString& error) {
+    QMutexLocker lock(&last_parse_error_mutex());
+    last_parse_error() = error;
+}
+
+static std::atomic<unsigned> parsed_nodes{0};
+
 
 using EByteArray = FigmaParser::EByteArray;
 
-#define ERR(...) {last_parse_error() = (toStr(__VA_ARGS__)); return std::nullopt;}
+#define ERR(...) {set_last_parse_error(toStr(__VA_ARGS__)); return std::nullopt;}
 
 static inline bool eq(double a, double b) {return std::fabs(a - b) < std::numeric_limits<double>::epsilon();}
 
@@ -91,7 +111,7 @@ QString toCamel(const QString& str, ARG... strs) {
 
 QByteArray FigmaParser::fontWeight(double v) {
    const auto scaled = ((v - 100) / 900) * 90; // figma scale is 100-900, where Qt is enums
-   const std::vector<std::pair<QByteArray, double>> weights { //from Qt docs
+   static const std::vector<std::pair<QByteArray, double>> weights { //from Qt docs
        {"Font.Thin", 0},
        {"Font.ExtraLight", 12},
        {"Font.Light", 25},
@@ -111,39 +131,121 @@ QByteArray FigmaParser::fontWeight(double v) {
 }
 
 
-std::optional<FigmaParser::ItemType> FigmaParser::type(const QJsonObject& obj) {
-   const QHash<QString, ItemType> types { //this to make sure we have a case for all types
-       {"RECTANGLE", ItemType::Vector},
-       {"TEXT", ItemType::Text},
-       {"COMPONENT", ItemType::Component},
-       {"BOOLEAN_OPERATION", ItemType::Boolean},
-       {"INSTANCE", ItemType::Instance},
-       {"ELLIPSE", ItemType::Vector},
-       {"VECTOR", ItemType::Vector},
-       {"LINE", ItemType::Vector},
-       {"REGULAR_POLYGON", ItemType::Vector},
-       {"STAR", ItemType::Vector},
-       {"GROUP", ItemType::Frame},
-       {"FRAME", ItemType::Frame},
-       {"SLICE", ItemType::None},
-       {"NONE", ItemType::None},
-       {"COMPONENT_SET", ItemType::Frame}
+FigmaParser::NodeType FigmaParser::nodeType(const QJsonObject& obj) {
+   static const QHash<QString, NodeType> types {
+       {"RECTANGLE", NodeType::Rectangle},
+       {"TEXT", NodeType::Text},
+       {"COMPONENT", NodeType::Component},
+       {"BOOLEAN_OPERATION", NodeType::BooleanOperation},
+       {"INSTANCE", NodeType::Instance},
+       {"ELLIPSE", NodeType::Ellipse},
+       {"VECTOR", NodeType::Vector},
+       {"LINE", NodeType::Line},
+       {"REGULAR_POLYGON", NodeType::RegularPolygon},
+       {"STAR", NodeType::Star},
+       {"GROUP", NodeType::Group},
+       {"FRAME", NodeType::Frame},
+       {"COMPONENT_SET", NodeType::ComponentSet},
+       {"SLICE", NodeType::Slice},
+       {"STAMP", NodeType::Stamp},
+       {"STICKY", NodeType::Sticky},
+       {"SHAPE_WITH_TEXT", NodeType::ShapeWithText},
+       {"NONE", NodeType::None}
+   };
+   return types.value(obj["type"].toString(), NodeType::Unknown);
+}
 
+std::optional<FigmaParser::ItemType> FigmaParser::itemType(NodeType type) {
+   switch(type) { //this to make sure we have a case for all types
+   case NodeType::Rectangle:
+   case NodeType::Ellipse:
+   case NodeType::Vector:
+   case NodeType::Line:
+   case NodeType::RegularPolygon:
+   case NodeType::Star:
+       return ItemType::Vector;
+   case NodeType::Text:
+       return ItemType::Text;
+   case NodeType::Component:
+       return ItemType::Component;
+   case NodeType::BooleanOperation:
+       return ItemType::Boolean;
+   case NodeType::Instance:
+       return ItemType::Instance;
+   case NodeType::Group:
+   case NodeType::Frame:
+   case NodeType::ComponentSet:
+       return ItemType::Frame;
+   case NodeType::Slice:
+   case NodeType::None:
+       return ItemType::None;
+   case NodeType::Stamp:
+   case NodeType::Sticky:
+   case NodeType::ShapeWithText:
+   case NodeType::Unknown:
+       break;
+   }
+   return std::nullopt;
+}
+
+FigmaParser::Constraint FigmaParser::constraint(const QString& value) {
+   static const QHash<QString, Constraint> constraints {
+       {"LEFT", Constraint::Min},
+       {"TOP", Constraint::Min},
+       {"RIGHT", Constraint::Max},
+       {"BOTTOM", Constraint::Max},
+       {"CENTER", Constraint::Center},
+       {"LEFT_RIGHT", Constraint::Stretch},
+       {"TOP_BOTTOM", Constraint::Stretch},
+       {"SCALE", Constraint::Scale}
    };
-   const auto type = obj["type"].toString();
-   if(!types.contains(type)) {
-       ERR(QString("Non supported object type:\"%1\"").arg(type))
+   return constraints.value(value, Constraint::Unknown);
+}
+
+FigmaParser::Fields FigmaParser::fields(const QJsonObject& obj) {
+   Fields fields;
+   fields.type = nodeType(obj);
+   fields.visible = obj["visible"].toBool(true);
+   if(const auto opacity = obj["opacity"]; !opacity.isUndefined())
+       fields.opacity = opacity.toDouble();
+   if(const auto transform = obj["relativeTransform"]; !transform.isUndefined()) {
+       const auto rows = transform.toArray();
+       const auto row1 = rows[0].toArray();
+       const auto row2 = rows[1].toArray();
+       fields.transform = std::array<double, 6>{row1[0].toDouble(), row1[1].toDouble(), row1[2].toDouble(),
+                                                row2[0].toDouble(), row2[1].toDouble(), row2[2].toDouble()};
    }
-   return types[type];
+   if(const auto size = obj["size"]; !size.isUndefined()) {
+       const auto s = size.toObject();
+       fields.size = QSizeF(s["x"].toDouble(), s["y"].toDouble());
+   }
+   if(const auto constraints = obj["constraints"]; !constraints.isUndefined()) {
+       const auto c = constraints.toObject();
+       fields.vertical = constraint(c["vertical"].toString());
+       fields.horizontal = constraint(c["horizontal"].toString());
+   }
+   fields.hasStrokes = !obj["strokes"].toArray().isEmpty();
+   if(const auto weight = obj["strokeWeight"]; !weight.isUndefined())
+       fields.strokeWeight = weight.toDouble();
+   const auto align = obj["strokeAlign"].toString();
+   fields.strokeAlign = align == QLatin1String("INSIDE") ? StrokeAlign::Inside
+           : align == QLatin1String("OUTSIDE") ? StrokeAlign::Outside : StrokeAlign::Center;
+   return fields;
 }
 
 
-std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject& project, FigmaParserData& data) {
-        Components map; 
-        auto componentObjects = getObjectsByType(project["document"].toObject(), "COMPONENT");
+FigmaIndex FigmaParser::documentIndex(const QJsonObject& project) {
+    return FigmaIndex(project["document"].toObject());
+}
+
+std::optional<QHash<QString, QJsonObject>> FigmaParser::componentObjects(const QJsonObject& project, const FigmaIndex& index, FigmaParserData& data) {
+        QHash<QString, QJsonObject> componentObjects;
         const auto components = project["components"].toObject();
         for (const auto& key : components.keys()) {
-            if(!componentObjects.contains(key)) {
+            const auto entry = index.entry(key);
+            if(entry && entry->type == QLatin1String("COMPONENT")) {
+                componentObjects.insert(key, entry->object);
+            } else {
                 const auto response = data.nodeData(key);
                 if(response.isEmpty()) {
                     ERR(toStr("Component not found", key, "for"))
@@ -151,21 +253,33 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                 QJsonParseError err;
                 const auto obj = QJsonDocument::fromJson(response, &err).object();
                 if(err.error == QJsonParseError::NoError) {
-                    const auto receivedObjects = getObjectsByType(obj["nodes"]
+                    const FigmaIndex received(obj["nodes"]
                             .toObject()[key]
                             .toObject()["document"]
-                            .toObject(), "COMPONENT");
-                    if(!receivedObjects.contains(key)) {
+                            .toObject());
+                    const auto receivedEntry = received.entry(key);
+                    if(!receivedEntry || receivedEntry->type != QLatin1String("COMPONENT")) {
                          ERR(toStr("Unrecognized component", key));
                     }
-                    componentObjects.insert(key, receivedObjects[key]);
+                    componentObjects.insert(key, receivedEntry->object);
                 } else {
                     ERR(toStr("Invalid component", key));
                 }
             }
+        }
+        return componentObjects;
+    }
+
+std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject& project, const FigmaIndex& index, FigmaParserData& data, FileNames& names) {
+        Components map; 
+        auto componentObjects = FigmaParser::componentObjects(project, index, data);
+        if(!componentObjects)
+            return std::nullopt;
+        const auto components = project["components"].toObject();
+        for (const auto& key : components.keys()) {
             const auto c = components[key].toObject();
             const auto componentName = c["name"].toString();
-            auto uniqueComponentName = validFileName(componentName, false); //names are expected to be unique, so we ensure so
+            auto uniqueComponentName = names.add(key, componentName); //names are expected to be unique, so we ensure so
             /*
             int count = 1;
             while(std::find_if(map.begin(), map.end(), [&uniqueComponentName](const auto& c) {
@@ -183,7 +297,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                                 key,
                                 c["key"].toString(),
                                 c["description"].toString(),
-                                std::move(componentObjects[key]))));
+                                std::move((*componentObjects)[key]))));
 
         }
         return map;
@@ -209,44 +323,36 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return array;
     }
 
-     std::optional<FigmaParser::Element> FigmaParser::component(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const Components& components) {
-        FigmaParser p(flags | Flags::ParseComponent, data, &components);
+     std::optional<FigmaParser::Element> FigmaParser::component(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const FigmaTree& tree) {
+        FigmaParser p(flags | Flags::ParseComponent, data, &tree);
         return p.getElement(obj);
     }
 
-     std::optional<FigmaParser::Element> FigmaParser::element(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const Components& components) {
-        FigmaParser p(flags, data, &components);
+     std::optional<FigmaParser::Element> FigmaParser::element(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const FigmaTree& tree) {
+        FigmaParser p(flags, data, &tree);
         return p.getElement(obj);
     }
 
-    QString FigmaParser::name(const QJsonObject& project) {
-         return project["name"].toString();
+    QStringList FigmaParser::missingComponents(const QJsonObject& project, const FigmaIndex& index) {
+        const auto components = project["components"].toObject();
+        QStringList missing;
+        for(const auto& key : components.keys()) {
+            const auto entry = index.entry(key);
+            if(!entry || entry->type != QLatin1String("COMPONENT"))
+                missing.append(key);
+        }
+        return missing;
     }
 
-    QString FigmaParser::validFileName(const QString& itemName, bool inited) {
-        if(itemName.isEmpty())
-            return QString();
-
-        Q_ASSERT(inited == itemName.endsWith(FIGMA_SUFFIX));
-        auto name = itemName;
-
-        // TODO this makes store-restore not to work as shall be cleaned inbetween access
-        // static is a bit cheap solution to ensure unique names, but proper fix (be a class member) requires some refactoring
-        // TODO a 'elegant' fix.
-        static QMap<QString, int> unique_names;
-
-        if(!inited) {
-            auto it = unique_names.find(name);
-            if(it == unique_names.end()) {
-                unique_names.insert(name, 0);
-            } else {
-                *it += 1; // if there add a name - note that this can be non-unique as well... :-/ ooof but let's go with this until
-                name += QString::number(*it);    // properly done....(if ever)
-            }
-            name += FIGMA_SUFFIX;
-           }
+    FigmaParser::Dependencies FigmaParser::dependencies(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const FigmaTree& tree) {
+        FigmaParser p(flags, data, &tree);
+        Dependencies dependencies;
+        p.collectDependencies(obj, dependencies);
+        return dependencies;
+    }
 
-        return makeFileName(name);
+    QString FigmaParser::name(const QJsonObject& project) {
+         return project["name"].toString();
     }
 
     QString FigmaParser::makeFileName(const QString& fileName) {
@@ -262,53 +368,8 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return name;
     }
 
-    FigmaParser::FigmaParser(unsigned flags, FigmaParserData& data, const Components* components) : m_flags(flags), m_data(data), m_components(components), m_parent{nullptr, nullptr, {}} {}
-
-    FigmaParser::~FigmaParser() {
-        while(m_parent.parent)      // this is NOT very rigid, but at least not leak :-/ (better would be assert here that all memory has freed (what push, its pop))
-            m_parent.pop();
-    }
-
-    QHash<QString, QJsonObject> FigmaParser::getObjectsByType(const QJsonObject& obj, const QString& type) {
-        QHash<QString, QJsonObject>objects;
-        if(obj["type"] == type) {
-            objects.insert(obj["id"].toString(), obj);
-        } else if(obj.contains("children")) {
-            const auto children = obj["children"].toArray();
-            for(const auto& child : children) {
-                const auto childrenobjects = getObjectsByType(child.toObject(), type);
-                const auto keys = childrenobjects.keys();
-                for(const auto& k : keys) {
-                    objects.insert(k, childrenobjects[k]);
-                }
-            }
-        }
-        return objects;
-    }
-
-    QJsonObject FigmaParser::delta(const QJsonObject& instance, const QJsonObject& base, const QSet<QString>& ignored, const QHash<QString, std::function<QJsonValue (const QJsonValue&, const QJsonValue&)>>& compares) {
-        QJsonObject newObject;
-        for(const auto& k : instance.keys()) {
-            if(ignored.contains(k))
-                continue;
-            if(!base.contains(k)) {
-                 newObject.insert(k, instance[k]);
-            } else if(compares.contains(k)) {
-                const QJsonValue ret = compares[k](base[k], instance[k]);
-                if(ret.type() != QJsonValue::Null) {
-                     newObject.insert(k, ret);
-                }
-            } else if(base[k] != instance[k]) {
-                newObject.insert(k, instance[k]);
-            }
-        }
-        //These items get wiped off, but are needed later - so we put them back
-        if(!newObject.isEmpty()) {
-            if(!ignored.contains("name") && instance.contains("name"))
-                newObject.insert("name", instance["name"]);
-        }
-        return newObject;
-    }
+    FigmaParser::FigmaParser(unsigned flags, FigmaParserData& data, const FigmaTree* tree) : m_flags(flags), m_data(data), m_tree(tree),
+        m_componentIds(&m_arena), m_scope(&m_arena), m_imageContext(&m_arena), m_aliases(&m_arena) {}
 
     QHash<QString, QString> FigmaParser::children(const QJsonObject& obj) {
         QHash<QString, QString> cList;
@@ -323,11 +384,17 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     }
 
     std::optional<FigmaParser::Element> FigmaParser::getElement(const QJsonObject& obj) {
-        m_parent.push(&obj);
-        RAII_ raii {[this](){m_parent.pop();}};
+        m_scope.push(obj);
+        RAII_ raii {[this](){m_scope.pop();}};
         auto bytes = parse(obj, 1);
         if(!bytes)
             return std::nullopt;
+        const auto unique = [](auto& list) {
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+        };
+        unique(m_componentIds);
+        unique(m_imageContext);
         QStringList ids(m_componentIds.begin(), m_componentIds.end());
 
         // Yet another face slap due poor parser desing
@@ -355,8 +422,13 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         for(const auto& alias : m_aliases)
             aliases.append(alias.id);
 
+        // names are resolved in the tree, in document order, so they do not depend on the generation order
+        auto elementName = m_tree ? m_tree->elementName(obj["id"].toString()) : QString();
+        if(elementName.isEmpty() && !obj["name"].toString().isEmpty())
+            elementName = makeFileName(obj["name"].toString() + FIGMA_SUFFIX);
+
         return Element{
-                validFileName(obj["name"].toString(), false),
+                elementName,
                 obj["id"].toString(),
                 obj["type"].toString(),
                 std::move(bytes.value()),
@@ -368,8 +440,8 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         };
     }
 
-    QString FigmaParser::tabs(int indents) const {
-        return QString(m_indent).repeated(indents);
+    QByteArray FigmaParser::tabs(int indents) const {
+        return QmlWriter::indentation(indents);
     }
 
 #if 0
@@ -413,25 +485,19 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     }
 #endif
      QByteArray FigmaParser::toColor(double r, double g, double b, double a) {
-        return QString("\"#%1%2%3%4\"")
-                .arg(static_cast<unsigned>(std::round(a * 255.)), 2, 16, QLatin1Char('0'))
-                .arg(static_cast<unsigned>(std::round(r * 255.)), 2, 16, QLatin1Char('0'))
-                .arg(static_cast<unsigned>(std::round(g * 255.)), 2, 16, QLatin1Char('0'))
-                .arg(static_cast<unsigned>(std::round(b * 255.)), 2, 16, QLatin1Char('0')).toLatin1();
+        const auto channel = [](double v) {return static_cast<unsigned>(std::round(v * 255.));};
+        QByteArray out;
+        out.reserve(11);
+        QmlWriter w(out);
+        w << "\"#";
+        w.hex(channel(a)).hex(channel(r)).hex(channel(g)).hex(channel(b)) << '"';
+        return out;
     }
 
      QByteArray FigmaParser::makeId(const QJsonObject& obj)  {
         QString cid = obj["id"].toString();
         static const QRegularExpression re(R"([^a-zA-Z0-9])");
-        const auto qml_id = ID_PREFIX + cid.replace(re, "_").toLower().toLatin1();
-        //if(qml_id == "figma_711_1213") {
-        //    qDebug() << "what is here?";
-        //}
-        /*
-        TODO: Really not working - why there are unable to find_id errors
-        if(m_parent.parent->parent)  // presumably this prevents toplevel alias?*/
-            m_parent.ids.insert(QString(qml_id));
-        return qml_id;
+        return ID_PREFIX + cid.replace(re, "_").toLower().toLatin1();
     }
 
      /*
@@ -441,7 +507,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
      QByteArray FigmaParser::makePropertyChangeHandler(int indents) {
          QByteArray out;
-         if(!m_aliases.isEmpty()) {
+         if(!m_aliases.empty()) {
              const auto indent = tabs(indents);
              const auto indent2 = tabs(indents + 1);
              const auto indent3 = tabs(indents + 2);
@@ -513,9 +579,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     QByteArray FigmaParser::makeId(const QString& prefix, const QJsonObject& obj)  {
         QString cid = obj["id"].toString();
         static const QRegularExpression re(R"([^a-zA-Z0-9])");
-        const auto qml_id = prefix.toLatin1() + ID_PREFIX + cid.replace(re, "_").toLower().toLatin1();
-        m_parent.ids.insert(QString(qml_id));
-        return qml_id;
+        return prefix.toLatin1() + ID_PREFIX + cid.replace(re, "_").toLower().toLatin1();
     }
 
      EByteArray FigmaParser::makeComponentInstance(const QString& type, const QJsonObject& obj, int indents, const QByteArray& change_receiver) {
@@ -533,7 +597,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             const auto id_string = makeId(obj);
             out += indent1 + "id: " + id_string + "\n";
             if(obj["name"].toString().startsWith(QML_TAG))
-                m_aliases.append({id_string, obj});
+                m_aliases.push_back({id_string, obj});
         // } else {
         //      out += indent1 + "id: athis\n";
         // }
@@ -542,14 +606,6 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
          if(!isQul()) // what was the role of objectName? To document, however not applicable for Qt for MCU
             out += indent1 + "objectName:\"" + obj["name"].toString().replace("\"", "\\\"") + "\"\n";
 
-         if(makeFileName(obj, "component").startsWith("Component__F")) {
-             qDebug() << "here is clear" <<  makeFileName(obj, "component") << generateAccess() << bool(m_flags & ParseComponent) << bool( m_componentLevel != 0);
-
-             //if(!(m_flags & ParseComponent)) {
-             //    qDebug() << "should be?";
-             //}
-         }
-
          if(generateAccess() && m_componentLevel != 0) { // when m_componentLevel is zero this is component to-file write
              APPENDERR(out, makeComponentPropertyChangeHandler(obj, indents, change_receiver));
          }
@@ -557,17 +613,17 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
          return out;
      }
 
-     EByteArray FigmaParser::makeItem(const QString& type, const QJsonObject& obj, int indents, const QByteArray& change_receiver) {
+     EByteArray FigmaParser::makeItem(const QString& type, const QJsonObject& obj, const Fields& fields, int indents, const QByteArray& change_receiver) {
         QByteArray out;
         const auto indent1 = tabs(indents);
         APPENDERR(out, makeComponentInstance(type, obj, indents, change_receiver));
         out += makeEffects(obj, indents);
-        out += makeTransforms(obj, indents);
-        if(obj.contains("visible") && !obj["visible"].toBool()) {
-            out += indent1 + "visible: false\n";
+        out += makeTransforms(obj, fields, indents);
+        if(!fields.visible) {
+            QmlWriter(out).indent(indents) << "visible: false\n";
         }
-        if(obj.contains("opacity")) {
-             out += indent1 + "opacity: " +  QString::number(obj["opacity"].toDouble()) + "\n";
+        if(fields.opacity) {
+            QmlWriter(out).indent(indents) << "opacity: " << *fields.opacity << '\n';
         }
 
         if(generateAccess()) {
@@ -593,27 +649,20 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return out;
     }
 
-    QPointF FigmaParser::position(const QJsonObject& obj) const {
-        const auto rows = obj["relativeTransform"].toArray();
-        const auto row1 = rows[0].toArray();
-        const auto row2 = rows[1].toArray();
-        return {row1[2].toDouble(), row2[2].toDouble()};
+    QPointF FigmaParser::position(const Fields& fields) {
+        Q_ASSERT(fields.transform);
+        return {(*fields.transform)[2], (*fields.transform)[5]};
     }
 
-    QByteArray FigmaParser::makeExtents(const QJsonObject& obj, int indents, const QRectF& extents) {
+    QByteArray FigmaParser::makeExtents(const QJsonObject& obj, const Fields& fields, int indents, const QRectF& extents) {
         QByteArray out;
-        QString horizontal("LEFT");
-        QString vertical("TOP");
-        const auto indent = tabs(indents);
-        if(obj.contains("constraints")) {
-            const auto constraints = obj["constraints"].toObject();
-            vertical = constraints["vertical"].toString();
-            horizontal = constraints["horizontal"].toString();
-        }
-        if(obj.contains("relativeTransform")) { //even figma may contain always this, the deltainstance may not
-            const auto p = position(obj);
-            Q_ASSERT(m_parent.parent);
-            const bool top_level = m_parent.parent->parent == nullptr;
+        QmlWriter w(out);
+        const auto horizontal = fields.horizontal;
+        const auto vertical = fields.vertical;
+        if(fields.transform) { //even figma may contain always this, the deltainstance may not
+            const auto p = position(fields);
+            Q_ASSERT(m_scope.depth() > 0);
+            const bool top_level = m_scope.depth() == 1;
             const auto tx = static_cast<int>(!top_level ? p.x() + extents.x() : extents.x());
             const auto ty = static_cast<int>(!top_level ? p.y() + extents.y() : extents.y());
 
@@ -623,58 +672,69 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             Q_ASSERT(ty < 2060);
 
 
-            if(horizontal == "LEFT" || horizontal == "SCALE" || horizontal == "LEFT_RIGHT" || horizontal == "RIGHT") {
-                out += indent + QString("x:%1\n").arg(tx);
-            } else if(horizontal == "CENTER") {
-                const auto parentWidth = m_parent["size"].toObject()["x"].toDouble();
-                const auto extent_id = QString(makeId(*m_parent.obj));
+            switch(horizontal) {
+            case Constraint::Min:
+            case Constraint::Max:
+            case Constraint::Stretch:
+            case Constraint::Scale:
+                w.indent(indents) << "x:" << tx << '\n';
+                break;
+            case Constraint::Center: {
+                const auto parentWidth = m_scope["size"].toObject()["x"].toDouble();
+                const auto extent_id = makeId(m_scope.object());
                 const auto width = getValue(obj, "size").toObject()["x"].toDouble();
                 const auto staticWidth = (parentWidth - width) / 2. - tx;
-                if(eq(staticWidth, 0))
-                    out += indent + QString("x: (%1.width - width) / 2\n").arg(extent_id);
-                else
-                    out += indent + QString("x: (%1.width - width) / 2 %2 %3\n").arg(extent_id).arg(staticWidth < 0 ? "+" : "-").arg(std::abs(staticWidth));
+                w.indent(indents) << "x: (" << extent_id << ".width - width) / 2";
+                if(!eq(staticWidth, 0))
+                    w << ' ' << (staticWidth < 0 ? '+' : '-') << ' ' << std::abs(staticWidth);
+                w << '\n';
+            } break;
+            case Constraint::Unknown:
+                break;
             }
 
-            if(vertical == "TOP" || vertical == "SCALE" || vertical == "TOP_BOTTOM" || vertical == "BOTTOM") {
-               out += indent + QString("y:%1\n").arg(ty);
-            } else  if(vertical == "CENTER") {
-                const auto parentHeight = m_parent["size"].toObject()["y"].toDouble();
-                const auto extent_id = QString(makeId(*m_parent.obj));
+            switch(vertical) {
+            case Constraint::Min:
+            case Constraint::Max:
+            case Constraint::Stretch:
+            case Constraint::Scale:
+               w.indent(indents) << "y:" << ty << '\n';
+               break;
+            case Constraint::Center: {
+                const auto parentHeight = m_scope["size"].toObject()["y"].toDouble();
+                const auto extent_id = makeId(m_scope.object());
                 const auto height = getValue(obj, "size").toObject()["y"].toDouble();
                 const auto staticHeight = (parentHeight - height) / 2. - ty;
-                if(eq(staticHeight, 0))
-                    out += indent + QString("y: (%1.height - height) / 2\n").arg(extent_id);
-                else
-                    out += indent + QString("y: (%1.height - height) / 2 %2 %3\n").arg(extent_id).arg(staticHeight < 0 ? "+" : "-").arg(std::abs(staticHeight));
+                w.indent(indents) << "y: (" << extent_id << ".height - height) / 2";
+                if(!eq(staticHeight, 0))
+                    w << ' ' << (staticHeight < 0 ? '+' : '-') << ' ' << std::abs(staticHeight);
+                w << '\n';
+            } break;
+            case Constraint::Unknown:
+                break;
             }
         }
-        if(obj.contains("size")) {
-            const auto vec = obj["size"];
-            const auto width = vec["x"].toDouble();
-            const auto height = vec["y"].toDouble();
-                out += indent + QString("width:%1\n").arg(width + extents.width());
-                out += indent + QString("height:%1\n").arg(height + extents.height());
+        if(fields.size) {
+            w.indent(indents) << "width:" << fields.size->width() + extents.width() << '\n';
+            w.indent(indents) << "height:" << fields.size->height() + extents.height() << '\n';
         }
         return out;
     }
 
-    QByteArray FigmaParser::makeSize(const QJsonObject& obj, int indents, const QSizeF& extents) {
+    QByteArray FigmaParser::makeSize(const Fields& fields, int indents, const QSizeF& extents) {
         QByteArray out;
-        const auto indent = tabs(indents);
-        const auto s = obj["size"].toObject();
-        const auto width = s["x"].toDouble()  + extents.width();
-        const auto height = s["y"].toDouble()  + extents.height();
-        out += indent + QString("width:%1\n").arg(width);
-        out += indent + QString("height:%1\n").arg(height);
+        const auto s = fields.size.value_or(QSizeF(0, 0));
+        const auto width = s.width()  + extents.width();
+        const auto height = s.height()  + extents.height();
+        QmlWriter(out).indent(indents) << "width:" << width << '\n';
+        QmlWriter(out).indent(indents) << "height:" << height << '\n';
         return out;
     }
 
     QByteArray FigmaParser::makeColor(const QJsonObject& obj, int indents, double opacity) {
         QByteArray out;
-        const auto indent = tabs(indents);
         Q_ASSERT(obj["r"].isDouble() && obj["g"].isDouble() && obj["b"].isDouble() && obj["a"].isDouble());
-        out += indent + "color:" + toColor(obj["r"].toDouble(), obj["g"].toDouble(), obj["b"].toDouble(), obj["a"].toDouble() * opacity) + "\n";
+        QmlWriter(out).indent(indents) << "color:" << toColor(obj["r"].toDouble(), obj["g"].toDouble(), obj["b"].toDouble(), obj["a"].toDouble() * opacity) << '\n';
         return out;
     }
 
@@ -697,14 +757,10 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                         const auto offset = e["offset"].toObject();
                         out += tabs(indents) + "layer.enabled:true\n";
                         out += tabs(indents) + "layer.effect: DropShadow {\n";
-                        if(effect["type"] == "INNER_SHADOW") {
-                            out += indent1 + "horizontalOffset: " + QString::number(-offset["x"].toDouble()) + "\n";
-                            out += indent1 + "verticalOffset: " + QString::number(-offset["y"].toDouble()) + "\n";
-                        } else {
-                            out += indent1 + "horizontalOffset: " + QString::number(offset["x"].toDouble()) + "\n";
-                            out += indent1 + "verticalOffset: " + QString::number(offset["y"].toDouble()) + "\n";
-                        }
-                        out += indent1 + "radius: " + QString::number(radius) + "\n";
+                        const auto sign = effect["type"] == "INNER_SHADOW" ? -1. : 1.;
+                        QmlWriter(out) << indent1 << "horizontalOffset: " << sign * offset["x"].toDouble() << '\n';
+                        QmlWriter(out) << indent1 << "verticalOffset: " << sign * offset["y"].toDouble() << '\n';
+                        QmlWriter(out) << indent1 << "radius: " << radius << '\n';
                         out += indent1 + "samples: 17\n";
                         out += indent1 + "color: " + toColor(
                                 color["r"].toDouble(),
@@ -719,29 +775,27 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     }
 
 
-    QByteArray FigmaParser::makeTransforms(const QJsonObject& obj, int indents) {
+    QByteArray FigmaParser::makeTransforms(const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
-        if(obj.contains("relativeTransform") && (!isQul()  // transforms has only a limited support ...
-                                                  || type(obj).value_or(FigmaParser::ItemType::None) == FigmaParser::ItemType::Text // only Text ...
+        if(fields.transform && (!isQul()  // transforms has only a limited support ...
+                                                  || fields.type == NodeType::Text // only Text ...
                                                   || isRendering(obj)    // ... and images ...
                                                   || imageFill(obj))) {    // ... I hope these handle most of the cases propertly enough ...) {
-            const auto rows = obj["relativeTransform"].toArray();
-            const auto row1 = rows[0].toArray();
-            const auto row2 = rows[1].toArray();
             const auto indent = tabs(indents + 1);
 
-            const double r1[3] = {row1[0].toDouble(), row1[1].toDouble(), row1[2].toDouble()};
-            const double r2[3] = {row2[0].toDouble(), row2[1].toDouble(), row2[2].toDouble()};
+            const auto r1 = fields.transform->data();
+            const auto r2 = fields.transform->data() + 3;
 
             if(!eq(r1[0], 1.0) || !eq(r1[1], 0.0) || !eq(r2[0], 0.0) || !eq(r2[1], 1.0)) {
-                out += tabs(indents) + "transform: Matrix4x4 {\n";
-                out += indent + "matrix: Qt.matrix4x4(\n";
-                out += indent + QString("%1, %2, %3, 0,\n").arg(r1[0]).arg(r1[1]).arg(r1[2]);
-                out += indent + QString("%1, %2, %3, 0,\n").arg(r2[0]).arg(r2[1]).arg(r2[2]);
-
-                out += indent + "0, 0, 1, 0,\n";
-                out += indent + "0, 0, 0, 1)\n";
-                out += tabs(indents) + "}\n";
+                QmlWriter w(out);
+                w.indent(indents) << "transform: Matrix4x4 {\n";
+                w << indent << "matrix: Qt.matrix4x4(\n";
+                w << indent << r1[0] << ", " << r1[1] << ", " << r1[2] << ", 0,\n";
+                w << indent << r2[0] << ", " << r2[1] << ", " << r2[2] << ", 0,\n";
+
+                w << indent << "0, 0, 1, 0,\n";
+                w << indent << "0, 0, 0, 1)\n";
+                w.indent(indents) << "}\n";
             }
         }
         return out;
@@ -749,7 +803,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
     EByteArray FigmaParser::makeImageSource(const QString& image, bool isRendering, int indents, const QString& placeHolder) {
         QByteArray out;
-        m_imageContext.insert(image);
+        m_imageContext.push_back(image);
         auto imageData = m_data.imageData(image, isRendering);
         if(imageData.isEmpty()) {
             if(placeHolder.isEmpty()) {
@@ -851,15 +905,15 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         */
         if(obj["type"].toString() == "GRADIENT_LINEAR" ) {
             out += idt1 + "LinearGradient {\n";
-            out += idt2 + "x1:" + QString::number(handle_positions[0].toObject()["x"].toDouble()) + "\n";
-            out += idt2 + "y1:" + QString::number(handle_positions[0].toObject()["y"].toDouble()) + "\n";
+            out += idt2 + "x1:" + QByteArray::number(handle_positions[0].toObject()["x"].toDouble()) + "\n";
+            out += idt2 + "y1:" + QByteArray::number(handle_positions[0].toObject()["y"].toDouble()) + "\n";
 
-            out += idt2 + "x2:" + QString::number(handle_positions[1].toObject()["x"].toDouble()) + "\n";
-            out += idt2 + "y2:" + QString::number(handle_positions[1].toObject()["y"].toDouble()) + "\n";
+            out += idt2 + "x2:" + QByteArray::number(handle_positions[1].toObject()["x"].toDouble()) + "\n";
+            out += idt2 + "y2:" + QByteArray::number(handle_positions[1].toObject()["y"].toDouble()) + "\n";
 
             for(const auto& stop : gradients_stops) {
                 out += idt2 + "GradientStop {\n";
-                out += idt3 + "position: " + QString::number(stop.toObject()["position"].toDouble()) + "\n";
+                out += idt3 + "position: " + QByteArray::number(stop.toObject()["position"].toDouble()) + "\n";
                 out += makeColor(stop.toObject()["color"].toObject(), indents + 3);
                 out += idt2 + "}\n";
             }
@@ -907,9 +961,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return out;
     }
 
-    EByteArray FigmaParser::makeVector(const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVector(const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
-        out += makeExtents(obj, indents);
+        out += makeExtents(obj, fields, indents);
         const auto fills = obj["fills"].toArray();
         if(fills.size() > 0) {
            APPENDERR(out, makeFill(fills[0].toObject(), indents));
@@ -924,7 +978,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     QByteArray FigmaParser::makeStrokeJoin(const QJsonObject& stroke, int indent) {
         QByteArray out;
         if(stroke.contains("strokeJoin")) {
-            const QHash<QString, QString> joins = {
+            static const QHash<QString, QString> joins = {
                {"MITER", "MiterJoin"},
                {"BEVEL", "MiterBevel"},
                {"ROUND", "MiterRound"}
@@ -939,7 +993,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     QByteArray FigmaParser::makeShapeStroke(const QJsonObject& obj, int indents, StrokeType type) {
         QByteArray out;
         const auto indent =  tabs(indents);
-        const QByteArray colorType = obj["type"] == "LINE" ? "fillColor" : "strokeColor"; //LINE works better this way
+        const QByteArray colorType = nodeType(obj) == NodeType::Line ? "fillColor" : "strokeColor"; //LINE works better this way
         if(obj.contains("strokes") && !obj["strokes"].toArray().isEmpty()) {
             const auto stroke = obj["strokes"].toArray()[0].toObject();
             out += makeStrokeJoin(stroke, indents);
@@ -960,7 +1014,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                 if(type == StrokeType::Double)
                     val *= 2.0;
                 }
-            out += indent + "strokeWidth:" + QString::number(val) + "\n";
+            out += indent + "strokeWidth:" + QByteArray::number(val) + "\n";
         }
         return out;
     }
@@ -968,7 +1022,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     QByteArray FigmaParser::makeShapeFill(const QJsonObject& obj, int indents) {
         QByteArray out;
         const auto indent =  tabs(indents);
-        if(obj["type"] != "LINE") {
+        if(nodeType(obj) != NodeType::Line) {
             if(obj.contains("fills") && !obj["fills"].toArray().isEmpty()) {
                 const auto fills = obj["fills"].toArray();
                 const auto fill = fills[0].toObject();
@@ -994,9 +1048,10 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
     EByteArray FigmaParser::makePlainItem(const QJsonObject& obj, int indents) {
         QByteArray out;
-        APPENDERR(out, makeItem("Rectangle", obj, indents)); //TODO: set to item
+        const auto f = fields(obj);
+        APPENDERR(out, makeItem("Rectangle", obj, f, indents)); //TODO: set to item
         APPENDERR(out, makeFill(obj, indents));
-        out += makeExtents(obj, indents);
+        out += makeExtents(obj, f, indents);
         APPENDERR(out, parseChildren(obj, indents));
         out += tabs(indents - 1) + "}\n";
         return out;
@@ -1022,29 +1077,10 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     }
 
     EByteArray FigmaParser::parse(const QJsonObject& obj, int indents) {
-        const auto type = obj["type"].toString();
-        const QHash<QString, std::function<EByteArray (const QJsonObject&, int)> > parsers {
-            {"RECTANGLE", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
-            {"TEXT", std::bind(&FigmaParser::parseText, this, std::placeholders::_1, std::placeholders::_2)},
-            {"COMPONENT", std::bind(&FigmaParser::parseComponent, this, std::placeholders::_1, std::placeholders::_2)},
-            {"BOOLEAN_OPERATION", std::bind(&FigmaParser::parseBooleanOperation, this, std::placeholders::_1, std::placeholders::_2)},
-            {"INSTANCE", std::bind(&FigmaParser::parseInstance, this, std::placeholders::_1, std::placeholders::_2)},
-            {"ELLIPSE", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
-            {"VECTOR", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
-            {"LINE", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
-            {"REGULAR_POLYGON", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
-            {"STAR", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
-            {"GROUP", std::bind(&FigmaParser::parseFrame, this, std::placeholders::_1, std::placeholders::_2)},
-            {"FRAME", std::bind(&FigmaParser::parseFrame, this, std::placeholders::_1, std::placeholders::_2)},
-            {"COMPONENT_SET", std::bind(&FigmaParser::parseFrame, this, std::placeholders::_1, std::placeholders::_2)},
-            {"SLICE", std::bind(&FigmaParser::parseSkip, this, std::placeholders::_1, std::placeholders::_2)},
-            {"STAMP", std::bind(&FigmaParser::parseSkip, this, std::placeholders::_1, std::placeholders::_2)},
-            {"STICKY", std::bind(&FigmaParser::parseSkip, this, std::placeholders::_1, std::placeholders::_2)},
-            {"SHAPE_WITH_TEXT", std::bind(&FigmaParser::parseSkip, this, std::placeholders::_1, std::placeholders::_2)},
-            {"NONE", [this](const QJsonObject& o, int i){return makePlainItem(o, i);}}
-        };
-        if(!parsers.contains(type)) {
-            ERR(QString("Non supported object type:\"%1\"").arg(type))
+        ++parsed_nodes;
+        const auto type = nodeType(obj);
+        if(type == NodeType::Unknown) {
+            ERR(QString("Non supported object type:\"%1\"").arg(obj["type"].toString()))
         }
 
         if(isRendering(obj)) {
@@ -1057,7 +1093,106 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             }
         }
 
-        return parsers[type](obj, indents);
+        switch(type) {
+        case NodeType::Rectangle:
+        case NodeType::Ellipse:
+        case NodeType::Vector:
+        case NodeType::Line:
+        case NodeType::RegularPolygon:
+        case NodeType::Star:
+            return parseVector(obj, indents);
+        case NodeType::Text:
+            return parseText(obj, indents);
+        case NodeType::Component:
+            return parseComponent(obj, indents);
+        case NodeType::BooleanOperation:
+            return parseBooleanOperation(obj, indents);
+        case NodeType::Instance:
+            return parseInstance(obj, indents);
+        case NodeType::Group:
+        case NodeType::Frame:
+        case NodeType::ComponentSet:
+            return parseFrame(obj, indents);
+        case NodeType::Slice:
+        case NodeType::Stamp:
+        case NodeType::Sticky:
+        case NodeType::ShapeWithText:
+            return parseSkip(obj, indents);
+        case NodeType::None:
+            return makePlainItem(obj, indents);
+        case NodeType::Unknown:
+            break;
+        }
+        Q_UNREACHABLE();
+        return std::nullopt;
+    }
+
+    // walks the tree along the same rules as parse(), but only collects what would be requested from FigmaParserData
+    void FigmaParser::collectDependencies(const QJsonObject& obj, Dependencies& dependencies) const {
+        const auto invisible = obj.contains("visible") && !obj["visible"].toBool();
+        if(isRendering(obj)) {
+            if(!invisible)
+                dependencies.renderings.insert(obj["id"].toString());
+            return;
+        }
+
+        if(generateAccess() && (m_flags & RenderLoaderPlaceHolders || m_flags & LoaderPlaceHolders)) {
+            if(const auto properties = getProperties(obj); properties && properties.value().var.contains(AS_LOADER)) {
+                if(!invisible && (m_flags & RenderLoaderPlaceHolders))
+                    dependencies.renderings.insert(obj["id"].toString());
+                return;
+            }
+        }
+
+        if(const auto image = imageFill(obj))
+            dependencies.images.insert(*image);
+        if(const auto image = imageFill(obj["style"].toObject()))
+            dependencies.images.insert(*image);
+        if(obj["style"].toObject().contains("fontFamily"))
+            dependencies.fonts.insert(obj["style"]["fontFamily"].toString());
+
+        const auto iType = itemType(nodeType(obj));
+        if(!iType)
+            return;
+        bool hasChildren = false;
+        switch(*iType) {
+        case ItemType::Frame:
+        case ItemType::None:
+        case ItemType::Instance:
+            hasChildren = true;
+            break;
+        case ItemType::Component:
+            hasChildren = m_flags & Flags::ParseComponent;
+            break;
+        case ItemType::Boolean:
+            hasChildren = (m_flags & Flags::BreakBooleans) && !isQul();
+            break;
+        default:
+            break;
+        }
+
+        if(!hasChildren)
+            return;
+        const auto children = obj["children"].toArray();
+        // instance children that do not override more than geometry are not generated, see makeInstanceChildren
+        if(nodeType(obj) == NodeType::Instance) {
+            const auto& components = m_tree->components();
+            const auto componentId = obj["componentId"].toString();
+            if(components.contains(componentId) && m_tree->node(obj["id"].toString())) {
+                const auto& comp = components[componentId]->object();
+                if(instanceChildrenMatched(obj, comp)) {
+                    const auto& node = *m_tree->node(obj["id"].toString());
+                    for(int i = 0; i < node.childIndices.size(); ++i) {
+                        const auto delta = instanceChildDelta(obj, i);
+                        if(!delta.isEmpty() && !isGeometryDelta(delta))
+                            collectDependencies(children[node.childIndices[i]].toObject(), dependencies);
+                    }
+                    return;
+                }
+            }
+        }
+        for(const auto& c : children)
+            collectDependencies(c.toObject(), dependencies);
     }
 
     bool FigmaParser::isGradient(const QJsonObject& obj) const {
@@ -1183,7 +1318,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
      QByteArray FigmaParser::makeAntialiasing(int indents) const {
          return !isQul() && (m_flags & AntialiasingShapes) ? // antialiazing is not supported
-            (tabs(indents) + "antialiasing: true\n").toLatin1() : QByteArray();
+            tabs(indents) + "antialiasing: true\n" : QByteArray();
      }
 
     /*
@@ -1191,13 +1326,13 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
       * to if-else hell and wrote open to keep normal/inside/outside and image/fill
       * cases managed
     */
-    EByteArray FigmaParser::makeVectorNormalFill(const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVectorNormalFill(const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
         // I would be trivial do a dynamic dispatching by figuring out runtime if property is intendent to this or path
         // but that wont work with MCU, but as Shape wont contain any useful properties to change, its more than fine pass them to ShapePath instead
         const auto shape_path_id = makeId(SVGPATH_PREFIX, obj);
-        APPENDERR(out, makeItem("Shape", obj, indents, shape_path_id));
-        out += makeExtents(obj, indents);
+        APPENDERR(out, makeItem("Shape", obj, fields, indents, shape_path_id));
+        out += makeExtents(obj, fields, indents);
 
         const auto indent = tabs(indents);
 
@@ -1222,13 +1357,13 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return out;
     }
 
-     EByteArray FigmaParser::makeVectorNormalFill(const QString& image, const QJsonObject& obj, int indents) {
+     EByteArray FigmaParser::makeVectorNormalFill(const QString& image, const QJsonObject& obj, const Fields& fields, int indents) {
          QByteArray out;
          const auto indent = tabs(indents);
          const auto indent1 = tabs(indents + 1);
 
-         APPENDERR(out, makeItem("Item", obj, indents));
-         out += makeExtents(obj, indents);
+         APPENDERR(out, makeItem("Item", obj, fields, indents));
+         out += makeExtents(obj, fields, indents);
 
         APPENDERR(out, makeImageMaskData(image, obj, indents));
 
@@ -1253,16 +1388,16 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
          return out;
      }
 
-    EByteArray FigmaParser::makeVectorNormal(const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVectorNormal(const QJsonObject& obj, const Fields& fields, int indents) {
         const auto image = imageFill(obj);
-        return image ? makeVectorNormalFill(*image, obj, indents) : makeVectorNormalFill(obj, indents);
+        return image ? makeVectorNormalFill(*image, obj, fields, indents) : makeVectorNormalFill(obj, fields, indents);
     }
 
-    EByteArray FigmaParser::makeVectorInsideFill(const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVectorInsideFill(const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
         out += tabs(indents - 1) + "// QML (SVG) supports only center borders, thus an extra mask is created for " + obj["strokeAlign"].toString()  + "\n";
-        APPENDERR(out, makeItem("Item", obj, indents));
-        out += makeExtents(obj, indents);
+        APPENDERR(out, makeItem("Item", obj, fields, indents));
+        out += makeExtents(obj, fields, indents);
         const auto borderSourceId = makeId("borderSource_", obj);
 
         const auto indent = tabs(indents);
@@ -1316,11 +1451,11 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return out;
     }
 
-    EByteArray FigmaParser::makeVectorInsideFill(const QString& image, const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVectorInsideFill(const QString& image, const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
         out += tabs(indents - 1) + "// QML (SVG) supports only center borders, thus an extra mask is created for " + obj["strokeAlign"].toString()  + "\n";
-        APPENDERR(out, makeItem("Item", obj, indents));
-        out += makeExtents(obj, indents);
+        APPENDERR(out, makeItem("Item", obj, fields, indents));
+        out += makeExtents(obj, fields, indents);
 
         const auto borderSourceId = makeId("borderSource_", obj);
 
@@ -1381,17 +1516,17 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
     }
 
-    EByteArray FigmaParser::makeVectorInside(const QJsonObject& obj, int indentsBase) {
+    EByteArray FigmaParser::makeVectorInside(const QJsonObject& obj, const Fields& fields, int indentsBase) {
         const auto image = imageFill(obj);
-        return image ? makeVectorInsideFill(*image, obj, indentsBase) : makeVectorInsideFill(obj, indentsBase);
+        return image ? makeVectorInsideFill(*image, obj, fields, indentsBase) : makeVectorInsideFill(obj, fields, indentsBase);
     }
 
-    EByteArray FigmaParser::makeVectorOutsideFill(const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVectorOutsideFill(const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
-        const auto borderWidth = obj["strokeWeight"].toDouble();
+        const auto borderWidth = fields.strokeWeight.value_or(0.);
         out += tabs(indents - 1) + "// QML (SVG) supports only center borders, thus an extra mask is created for " + obj["strokeAlign"].toString()  + "\n";
-        APPENDERR(out, makeItem("Item", obj, indents));
-        out += makeExtents(obj, indents, {-borderWidth, -borderWidth, borderWidth * 2., borderWidth * 2.}); //since borders shall fit in we must expand (otherwise the mask is not big enough, it always clips)
+        APPENDERR(out, makeItem("Item", obj, fields, indents));
+        out += makeExtents(obj, fields, indents, {-borderWidth, -borderWidth, borderWidth * 2., borderWidth * 2.}); //since borders shall fit in we must expand (otherwise the mask is not big enough, it always clips)
 
         const auto borderSourceId = makeId( "borderSource_", obj);
 
@@ -1402,9 +1537,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
         out += indent + "Shape {\n";
 
-        out += indent1 + "x: " + QString::number(borderWidth) + "\n";
-        out += indent1 + "y: " + QString::number(borderWidth) + "\n";
-        out += makeSize(obj, indents + 1);
+        out += indent1 + "x: " + QByteArray::number(borderWidth) + "\n";
+        out += indent1 + "y: " + QByteArray::number(borderWidth) + "\n";
+        out += makeSize(fields, indents + 1);
         out += makeAntialiasing(indents + 1);
         out += indent1 + "ShapePath {\n";
         out += makeShapeFill(obj, indents + 2);
@@ -1424,9 +1559,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         out += indent1 + "visible: false\n";
         out += indent1 + "Shape {\n";
         out += makeAntialiasing(indents + 2);
-        out += indent2 + "x: " + QString::number(borderWidth) + "\n";
-        out += indent2 + "y: " + QString::number(borderWidth) + "\n";
-        out += makeSize(obj, indents + 2);
+        out += indent2 + "x: " + QByteArray::number(borderWidth) + "\n";
+        out += indent2 + "y: " + QByteArray::number(borderWidth) + "\n";
+        out += makeSize(fields, indents + 2);
         out += indent2 + "ShapePath {\n";
         out += indent3 + "fillColor: \"black\"\n";
         out += makeShapeStroke(obj,  indents + 3, StrokeType::Double);
@@ -1445,14 +1580,14 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         out += makeAntialiasing(indents + 1);
         out += indent1 + "visible: false\n";
         out += indent1 + "Shape {\n";
-        out += indent2 + "x: " + QString::number(borderWidth) + "\n";
-        out += indent2 + "y: " + QString::number(borderWidth) + "\n";
-        out += makeSize(obj, indents + 2);
+        out += indent2 + "x: " + QByteArray::number(borderWidth) + "\n";
+        out += indent2 + "y: " + QByteArray::number(borderWidth) + "\n";
+        out += makeSize(fields, indents + 2);
 
         out += indent2 + "ShapePath {\n";
         out += indent3 + "fillColor: \"black\"\n";
         out += indent3 + "strokeColor: \"transparent\"\n";
-        out += indent3 + "strokeWidth: "  + QString::number(borderWidth) + "\n";
+        out += indent3 + "strokeWidth: "  + QByteArray::number(borderWidth) + "\n";
         out += indent3 + "joinStyle: ShapePath.MiterJoin\n";
 
         out += makeShapeFillData(obj, indents + 3);
@@ -1475,12 +1610,12 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return out;
     }
 
-    EByteArray FigmaParser::makeVectorOutsideFill(const QString& image, const QJsonObject& obj, int indents) {
+    EByteArray FigmaParser::makeVectorOutsideFill(const QString& image, const QJsonObject& obj, const Fields& fields, int indents) {
         QByteArray out;
-        const auto borderWidth = obj["strokeWeight"].toDouble();
+        const auto borderWidth = fields.strokeWeight.value_or(0.);
         out += tabs(indents - 1) + "// QML (SVG) supports only center borders, thus an extra mask is created for " + obj["strokeAlign"].toString()  + "\n";
-        APPENDERR(out, makeItem("Item", obj, indents));
-        out += makeExtents(obj, indents, {-borderWidth, -borderWidth, borderWidth * 2., borderWidth * 2.}); //since borders shall fit in we must expand (otherwise the mask is not big enough, it always clips)
+        APPENDERR(out, makeItem("Item", obj, fields, indents));
+        out += makeExtents(obj, fields, indents, {-borderWidth, -borderWidth, borderWidth * 2., borderWidth * 2.}); //since borders shall fit in we must expand (otherwise the mask is not big enough, it always clips)
 
         const auto borderSourceId = makeId("borderSource_", obj);
 
@@ -1490,9 +1625,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         const auto indent3 = tabs(indents + 3);
 
         out += indent + "Item {\n";
-        out += indent1 + "x: " + QString::number(borderWidth) + "\n";
-        out += indent1 + "y: " + QString::number(borderWidth) + "\n";
-        out += makeSize(obj, indents + 1);
+        out += indent1 + "x: " + QByteArray::number(borderWidth) + "\n";
+        out += indent1 + "y: " + QByteArray::number(borderWidth) + "\n";
+        out += makeSize(fields, indents + 1);
         out += makeAntialiasing(indents + 1);
 
         APPENDERR(out, makeImageMaskData(image, obj, indents + 1));
@@ -1517,9 +1652,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         out += indent1 + "visible: false\n";
         out += indent1 + "Shape {\n";
         out += makeAntialiasing(indents + 2);
-        out += indent2 + "x: " + QString::number(borderWidth) + "\n";
-        out += indent2 + "y: " + QString::number(borderWidth) + "\n";
-        out += makeSize(obj, indents + 2);
+        out += indent2 + "x: " + QByteArray::number(borderWidth) + "\n";
+        out += indent2 + "y: " + QByteArray::number(borderWidth) + "\n";
+        out += makeSize(fields, indents + 2);
         out += indent2 + "ShapePath {\n";
         out += indent3 + "fillColor: \"black\"\n";
         out += makeShapeStroke(obj,  indents + 3, StrokeType::Double);
@@ -1537,14 +1672,14 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         out += makeAntialiasing(indents + 1);
         out += indent1 + "visible: false\n";
         out += indent1 + "Shape {\n";
-        out += indent2 + "x: " + QString::number(borderWidth) + "\n";
-        out += indent2 + "y: " + QString::number(borderWidth) + "\n";
-        out += makeSize(obj, indents + 2);
+        out += indent2 + "x: " + QByteArray::number(borderWidth) + "\n";
+        out += indent2 + "y: " + QByteArray::number(borderWidth) + "\n";
+        out += makeSize(fields, indents + 2);
 
         out += indent2 + "ShapePath {\n";
         out += indent3 + "fillColor: \"black\"\n";
         out += indent3 + "strokeColor: \"transparent\"\n";
-        out += indent3 + "strokeWidth: "  + QString::number(borderWidth) + "\n";
+        out += indent3 + "strokeWidth: "  + QByteArray::number(borderWidth) + "\n";
         out += indent3 + "joinStyle: ShapePath.MiterJoin\n";
 
         out += makeShapeFillData(obj, indents + 3);
@@ -1567,9 +1702,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return out;
     }
 
-    EByteArray FigmaParser::makeVectorOutside(const QJsonObject& obj, int indentsBase) {
+    EByteArray FigmaParser::makeVectorOutside(const QJsonObject& obj, const Fields& fields, int indentsBase) {
         const auto image = imageFill(obj);
-        return image ? makeVectorOutsideFill(*image, obj, indentsBase) : makeVectorOutsideFill(obj, indentsBase);
+        return image ? makeVectorOutsideFill(*image, obj, fields, indentsBase) : makeVectorOutsideFill(obj, fields, indentsBase);
     }
 
 
@@ -1577,13 +1712,14 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
     EByteArray FigmaParser::parseVector(const QJsonObject& obj, int indents) {
 
-        const auto hasBorders = obj.contains("strokes") && !obj["strokes"].toArray().isEmpty() && obj.contains("strokeWeight") && obj["strokeWeight"].toDouble() > 1.0;
-        if(hasBorders && obj["strokeAlign"] == "INSIDE")
-            return makeVectorInside(obj, indents);
-        if(hasBorders && obj["strokeAlign"] == "OUTSIDE")
-            return makeVectorOutside(obj, indents);
+        const auto f = fields(obj);
+        const auto hasBorders = f.hasStrokes && f.strokeWeight.value_or(0.) > 1.0;
+        if(hasBorders && f.strokeAlign == StrokeAlign::Inside)
+            return makeVectorInside(obj, f, indents);
+        if(hasBorders && f.strokeAlign == StrokeAlign::Outside)
+            return makeVectorOutside(obj, f, indents);
         else
-            return makeVectorNormal(obj, indents);
+            return makeVectorNormal(obj, f, indents);
 
     }
 
@@ -1596,7 +1732,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         styles.insert("font.pixelSize", QString::number(static_cast<int>(std::floor(obj["fontSize"].toDouble()))));
         styles.insert("font.weight", QString(fontWeight(obj["fontWeight"].toDouble())));
         if(obj.contains("textCase")) {
-            const QHash<QString, QString> capitalization {
+            static const QHash<QString, QString> capitalization {
                 {"UPPER", "Font.AllUppercase"},
                 {"LOWER", "Font.AllLowercase"},
                 {"TITLE", "Font.MixedCase"},
@@ -1607,7 +1743,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             styles.insert("font.capitalization",  capitalization[obj["textCase"].toString()]);
         }
         if(obj.contains("textDecoration")) {
-            const QHash<QString, QString> decoration {
+            static const QHash<QString, QString> decoration {
                 {"STRIKETHROUGH", "strikeout"},
                 {"UNDERLINE", "underline"}
             };
@@ -1620,14 +1756,14 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             styles.insert("leftPadding", QString::number(obj["paragraphIndent"].toInt()));
         }
 
-        const QHash<QString,  QString> hAlign {
+        static const QHash<QString,  QString> hAlign {
             {"LEFT", "Text.AlignLeft"},
             {"RIGHT", "Text.AlignRight"},
             {"CENTER", "Text.AlignHCenter"},
             {"JUSTIFIED", "Text.AlignJustify"}
         };
         styles.insert("horizontalAlignment", hAlign[obj["textAlignHorizontal"].toString()]);
-        const QHash<QString, QString> vAlign {
+        static const QHash<QString, QString> vAlign {
             {"TOP", "Text.AlignTop"},
             {"BOTTOM", "Text.AlignBottom"},
             {"CENTER", "Text.AlignVCenter"}
@@ -1658,25 +1794,28 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
      bool FigmaParser::isRendering(const QJsonObject& obj) const {
         if(obj["isRendering"].toBool())
             return true;
-        if(type(obj) == ItemType::Vector && (m_flags & PrerenderShapes || isGradient(obj))) // || /*(m_flags & PrerenderGradients &&*/ isGradient(obj)))
+        const auto nType = nodeType(obj);
+        const auto iType = itemType(nType);
+        if(iType == ItemType::Vector && (m_flags & PrerenderShapes || isGradient(obj))) // || /*(m_flags & PrerenderGradients &&*/ isGradient(obj)))
             return true;
-        if(type(obj) == ItemType::Text && /*(m_flags & PrerenderGradients &&*/ isGradient((obj)))
+        if(iType == ItemType::Text && /*(m_flags & PrerenderGradients &&*/ isGradient((obj)))
             return true;
-        if(type(obj) == ItemType::Frame && (obj["type"].toString() != "GROUP") && (m_flags & Flags::PrerenderFrames))
+        if(iType == ItemType::Frame && (nType != NodeType::Group) && (m_flags & Flags::PrerenderFrames))
             return true;
-        if(obj["type"].toString() == "GROUP" && (m_flags & Flags::PrerenderGroups))
+        if(nType == NodeType::Group && (m_flags & Flags::PrerenderGroups))
             return true;
-        if(type(obj) == ItemType::Component && (m_flags & Flags::PrerenderComponents /*|| (m_flags & PrerenderGradients && isGradient(obj)) */)) // prerender here makes figma respond with errors
+        if(iType == ItemType::Component && (m_flags & Flags::PrerenderComponents /*|| (m_flags & PrerenderGradients && isGradient(obj)) */)) // prerender here makes figma respond with errors
             return true;
-        if(type(obj) == ItemType::Instance && (m_flags & Flags::PrerenderInstances /*|| (m_flags & PrerenderGradients && isGradient(obj)) */))
+        if(iType == ItemType::Instance && (m_flags & Flags::PrerenderInstances /*|| (m_flags & PrerenderGradients && isGradient(obj)) */))
             return true;
         return false;
     }
 
     EByteArray FigmaParser::parseText(const QJsonObject& obj, int indents) {
         QByteArray out;
-        APPENDERR(out, makeItem("Text", obj, indents));
-        APPENDERR(out, makeVector(obj, indents));
+        const auto f = fields(obj);
+        APPENDERR(out, makeItem("Text", obj, f, indents));
+        APPENDERR(out, makeVector(obj, f, indents));
         const auto indent = tabs(indents);
         if(!isQul()) // word wrap is not supported
             out += indent + "wrapMode: TextEdit.WordWrap\n";
@@ -1694,11 +1833,12 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
      EByteArray FigmaParser::parseFrame(const QJsonObject& obj, int indents) {
          QByteArray out;
-         APPENDERR(out, makeItem("Rectangle", obj, indents));
-         APPENDERR(out, makeVector(obj, indents));
+         const auto f = fields(obj);
+         APPENDERR(out, makeItem("Rectangle", obj, f, indents));
+         APPENDERR(out, makeVector(obj, f, indents));
          const auto indent = tabs(indents);
          if(obj.contains("cornerRadius")) {
-             out += indent + "radius:" + QString::number(obj["cornerRadius"].toDouble()) + "\n";
+             out += indent + "radius:" + QByteArray::number(obj["cornerRadius"].toDouble()) + "\n";
          }
          out += indent + "clip: " + (obj["clipsContent"].toBool() ? "true" : "false") + " \n";
          APPENDERR(out, parseChildren(obj, indents));
@@ -1796,10 +1936,11 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         } else {
              const auto indent = tabs(indents);
             QByteArray out;
-             APPENDERR(out, makeItem("Rectangle", obj, indents));
-             APPENDERR(out, makeVector(obj, indents));
+             const auto f = fields(obj);
+             APPENDERR(out, makeItem("Rectangle", obj, f, indents));
+             APPENDERR(out, makeVector(obj, f, indents));
              if(obj.contains("cornerRadius")) {
-                 out += indent + "radius:" + QString::number(obj["cornerRadius"].toDouble()) + "\n";
+                 out += indent + "radius:" + QByteArray::number(obj["cornerRadius"].toDouble()) + "\n";
              }
              out += indent + "clip: " + (obj["clipsContent"].toBool() ? "true" : "false") + " \n";
 
@@ -2073,8 +2214,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
          const auto operation = obj["booleanOperation"].toString();
 
          QByteArray out;
-         APPENDERR(out, makeItem("Item", obj, indents));
-         out += makeExtents(obj, indents);
+         const auto f = fields(obj);
+         APPENDERR(out, makeItem("Item", obj, f, indents));
+         out += makeExtents(obj, f, indents);
          //const auto indent = tabs(indents);
          //const auto indent1 = tabs(indents + 1);
          const auto sourceId = makeId("source_", obj);
@@ -2178,8 +2320,8 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
          QByteArray out;
          APPENDERR(out, makeComponentInstance("Item", obj, indents));
          const auto indent = tabs(indents );
-         Q_ASSERT(m_parent.obj->contains("absoluteBoundingBox"));
-         const auto prect = m_parent["absoluteBoundingBox"].toObject();
+         Q_ASSERT(m_scope.object().contains("absoluteBoundingBox"));
+         const auto prect = m_scope["absoluteBoundingBox"].toObject();
          const auto px = prect["x"].toDouble();
          const auto py = prect["y"].toDouble();
 
@@ -2221,56 +2363,43 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         // m_componentLevel should propably apply for Qul only
         ++m_componentLevel;
         RAII_ raii {[this](){--m_componentLevel;}};
+        const auto& node = *m_tree->node(obj["id"].toString()); // parseInstance has checked
         const auto compChildren = comp["children"].toArray();
         const auto objChildren = obj["children"].toArray();
-        auto children = parseChildrenItems(obj, indents);  //const not accepted! bug in VC??
-        if(!children)
-            return std::nullopt;
-        if(compChildren.size() != children->size()) { //TODO: better heuristics what to do if kids count wont match, problem is z-order, but we can do better
+        if(!instanceChildrenMatched(obj, comp)) { //TODO: better heuristics what to do if kids count wont match, problem is z-order, but we can do better
+            const auto children = parseChildrenItems(obj, indents);
+            if(!children)
+                return std::nullopt;
             for(const auto& [k, bytes] : *children)
                 out += bytes;
             return out;
         }
-     //   QSet<QString> unmatched = QSet<QString>::fromList(children.keys());
-     //   Q_ASSERT(compChildren.size() == children.size());
-        const auto keys = children->keys();
+        // only the children that override more than their geometry are generated
+        m_scope.push(obj);
+        RAII_ scope {[this](){m_scope.pop();}};
         const auto indent = tabs(indents);
-        for(const auto& cc : compChildren) {
-            //first we find the corresponsing object child
-            const auto cchild = cc.toObject();
-
+        for(int i = 0; i < compChildren.size(); ++i) {
+            //first we find the corresponsing object child, matched in the tree
+            const auto cchild = compChildren[i].toObject();
             const auto id = cchild["id"].toString();
-            //when it's keys last section  match
-            const auto keyit = std::find_if(keys.begin(), keys.end(), [&id](const auto& key){return key.split(';').last() == id;});
-            Q_ASSERT(keyit != keys.end());
-            //and get its index
-        //    Q_ASSERT(unmatched.contains(*keyit));
-        //    unmatched.remove(*keyit);
-            const auto index = std::distance(keys.begin(), keyit);
+            const auto index = node.childIndices[i];
             //here we have it
             const auto objChild = objChildren[index].toObject();
-            //Then we compare to to find delta, we ignore absoluteBoundingBox as size and transformations are aliases
-            const auto deltaObject = delta(objChild, cchild, {"absoluteBoundingBox", "name", "id"}, {{"children", [objChild, this](const auto& o, const auto& c) {
-                                                                                                          return (type(objChild) == ItemType::Boolean && !(m_flags & BreakBooleans)) || o == c ? QJsonValue() : c;
-                                                                                                      }}});
+            //Then delta, that is compared in the tree
+            const auto deltaObject = instanceChildDelta(obj, i);
 
             // difference, nothing to override
             if(deltaObject.isEmpty())
                 continue;
 
-            if(deltaObject.size() <= 2
-                    && ((deltaObject.size() == 2
-                         && deltaObject.contains("relativeTransform")
-                         && deltaObject.contains("size"))
-                        || (deltaObject.size() == 1
-                            && (deltaObject.contains("relativeTransform")
-                                || deltaObject.contains("size"))))) {
+            if(isGeometryDelta(deltaObject)) {
                 const auto delegateId = delegateName(id);
                 if(deltaObject.contains("relativeTransform")) {
-                    const auto transform = makeTransforms(objChild, indents + 1);
+                    const auto childFields = fields(objChild);
+                    const auto transform = makeTransforms(objChild, childFields, indents + 1);
                     if(!transform.isEmpty())
                         out += indent + QString("%1_transform: %2\n").arg(delegateId, QString(transform));
-                    const auto pos = position(objChild);
+                    const auto pos = childFields.transform ? position(childFields) : QPointF();
                     out += indent + QString("%1_x: %2\n").arg(delegateId).arg(static_cast<int>(pos.x()));
                     out += indent + QString("%1_y: %2\n").arg(delegateId).arg(static_cast<int>(pos.y()));
                 }
@@ -2281,14 +2410,16 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                 }
                 continue;
             }
-            const auto child_item = (*children)[*keyit];     
+            const auto child_item = parse(objChild, indents + 1);
+            if(!child_item)
+                return std::nullopt;
 
             if(isQul()) {
-                const auto sub_component =  addComponentStream(cchild, child_item);
+                const auto sub_component =  addComponentStream(cchild, *child_item);
                 Q_ASSERT(!sub_component.isEmpty());
                 out += indent + delegateName(id) + ": \"" + sub_component + "\"\n";
             } else {
-                out += indent + delegateName(id) + ": " + child_item;
+                out += indent + delegateName(id) + ": " + *child_item;
             }
 
         }
@@ -2298,29 +2429,66 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
     QJsonValue FigmaParser::getValue(const QJsonObject& obj, const QString& key) const {
         if(obj.contains(key))
             return obj[key];
-        else if(type(obj) == ItemType::Instance) {
-            return getValue((*m_components)[obj["componentId"].toString()]->object(), key);
+        else if(const auto node = m_tree->node(obj["id"].toString()); node && !node->componentId.isEmpty()) {
+            return getValue(m_tree->components()[node->componentId]->object(), key);
         }
         return QJsonValue();
     }
 
+     // instance children are overridden one by one only if each component child has its instance child
+     bool FigmaParser::instanceChildrenMatched(const QJsonObject& obj, const QJsonObject& comp) const {
+        const auto& node = *m_tree->node(obj["id"].toString());
+        const auto compChildren = comp["children"].toArray();
+        const auto objChildren = obj["children"].toArray();
+        return compChildren.size() == objChildren.size()
+                && node.childIndices.size() == compChildren.size()
+                && std::none_of(node.childIndices.begin(), node.childIndices.end(), [](auto index) {return index < 0;})
+                && std::none_of(objChildren.begin(), objChildren.end(), [](const auto& c) {return c.toObject()["isMask"].toBool();});
+     }
+
+     // delta of a matched instance child, only the boolean children depends on flags
+     QJsonObject FigmaParser::instanceChildDelta(const QJsonObject& obj, int componentChild) const {
+        const auto& node = *m_tree->node(obj["id"].toString());
+        auto delta = node.childDeltas[componentChild];
+        const auto objChild = obj["children"].toArray()[node.childIndices[componentChild]].toObject();
+        if(nodeType(objChild) == NodeType::BooleanOperation && !(m_flags & BreakBooleans))
+            delta.remove("children");
+        return delta;
+     }
+
+     // only position and size are overridden, the delegate of the component is kept
+     bool FigmaParser::isGeometryDelta(const QJsonObject& delta) {
+        return delta.size() <= 2
+                && ((delta.size() == 2
+                     && delta.contains("relativeTransform")
+                     && delta.contains("size"))
+                    || (delta.size() == 1
+                        && (delta.contains("relativeTransform")
+                            || delta.contains("size"))));
+     }
+
      EByteArray FigmaParser::parseInstance(const QJsonObject& obj, int indents) {
          QByteArray out;
-         const auto isInstance = type(obj) == ItemType::Instance;
+         const auto isInstance = nodeType(obj) == NodeType::Instance;
          const auto componentId = (isInstance ? obj["componentId"] : obj["id"]).toString();
-         m_componentIds.insert(componentId);
+         m_componentIds.push_back(componentId);
 
-         if(!m_components->contains(componentId)) {
+         const auto& components = m_tree->components();
+         if(!components.contains(componentId)) {
              ERR("Unexpected component dependency from", obj["id"].toString(), "to", componentId);
          }
 
-         const auto comp = (*m_components)[componentId];
+         const auto comp = components[componentId];
 
          if(!isInstance) {
              APPENDERR(out, makeComponentInstance(comp->name(), obj, indents));
          } else {
 
-             auto instanceObject = delta(obj, comp->object(), {"children"}, {});
+             const auto node = m_tree->node(obj["id"].toString());
+             if(!node) {
+                 ERR("Unresolved instance", obj["id"].toString());
+             }
+             auto instanceObject = node->instanceDelta;
 
              //Just dummy to prevent transparent
              if(obj.contains("fills") && !instanceObject.contains("fills")) {
@@ -2332,8 +2500,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                  instanceObject.insert("strokes", "");
              }
 
-             APPENDERR(out, makeItem(comp->name(), instanceObject, indents));
-             APPENDERR(out, makeVector(instanceObject, indents));
+             const auto f = fields(instanceObject);
+             APPENDERR(out, makeItem(comp->name(), instanceObject, f, indents));
+             APPENDERR(out, makeVector(instanceObject, f, indents));
 
              APPENDERR(out, makeInstanceChildren(obj, comp->object(), indents));
          }
@@ -2351,7 +2520,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
           // add alias set signal
 
-          if(!m_parent.parent->parent && generateAccess()) {
+          if(m_scope.depth() == 1 && generateAccess()) {
             out += makePropertyChangeHandler(indents);
             }
           return out;
@@ -2387,13 +2556,12 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
     std::optional<OrderedMap<QString, QByteArray>> FigmaParser::parseChildrenItems(const QJsonObject& obj, int indents) {
         OrderedMap<QString, QByteArray> childrenItems;
-        m_parent.push(&obj);
+        m_scope.push(obj);
         if(obj.contains("children")) {
             bool hasMask = false;
             QByteArray out;
             auto children = obj["children"].toArray();
             for(const auto& c : children) {
-                //m_parent = {&obj, m_parent};
                 auto child = c.toObject();
                 const bool isMask = child.contains("isMask") && child["isMask"].toBool(); //mask may not be the first, but it masks the rest
                 if(isMask) {
@@ -2415,27 +2583,125 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                 childrenItems.insert("maskedItem", out);
             }
         }
-        //m_parent = parent;
-        m_parent.pop();
+        m_scope.pop();
         return childrenItems;
     }
 
     QString FigmaParser::lastError() {
+        QMutexLocker lock(&last_parse_error_mutex());
         return last_parse_error();
     }
 
-    QString FigmaParser::makeFileName(const QJsonObject& obj, const QString& prefix) const {
-        const auto name = prefix + '_' + obj["name"].toString() + '_' + obj["id"].toString() + "_" + QString::number(m_data.unique_number()) + FIGMA_SUFFIX;
-        const auto filename = makeFileName(name).toLatin1();
-        return filename;
+    unsigned FigmaParser::parsedNodes() {
+        return parsed_nodes;
     }
 
+    // name is derived from the node name and its code, so the same code gets the same name in every run, job and element
+    QString FigmaParser::makeFileName(const QJsonObject& obj, const QString& prefix, const QByteArray& content, int variant) {
+        const auto digest = QCryptographicHash::hash(content, QCryptographicHash::Sha1).left(8).toHex();
+        auto name = prefix + '_' + obj["name"].toString() + "_" + QString::fromLatin1(digest);
+        if(variant > 0)
+            name += '_' + QString::number(variant);
+        return makeFileName(name + FIGMA_SUFFIX);
+    }
+
+
+    // Identifiers of QML code as (start, end) offsets, string literals and comments are skipped
+    static std::vector<std::pair<qsizetype, qsizetype>> identifiers(const QString& text) {
+        const auto isIdentifier = [](QChar c) {
+            const auto u = c.unicode();
+            return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '_';
+        };
+        std::vector<std::pair<qsizetype, qsizetype>> tokens;
+        const auto size = text.size();
+        for(qsizetype i = 0; i < size;) {
+            const auto c = text[i];
+            if(c == '"' || c == '\'') {
+                for(++i; i < size && text[i] != c; ++i) {
+                    if(text[i] == '\\')
+                        ++i;
+                }
+                ++i;
+            } else if(c == '/' && i + 1 < size && text[i + 1] == '/') {
+                i = text.indexOf('\n', i);
+                if(i < 0)
+                    i = size;
+            } else if(c == '/' && i + 1 < size && text[i + 1] == '*') {
+                i = text.indexOf("*/", i + 2);
+                i = i < 0 ? size : i + 2;
+            } else if(isIdentifier(c) && !c.isDigit() && (i == 0 || !isIdentifier(text[i - 1]))) {
+                auto end = i + 1;
+                while(end < size && isIdentifier(text[end]))
+                    ++end;
+                tokens.emplace_back(i, end);
+                i = end;
+            } else
+                ++i;
+        }
+        return tokens;
+    }
+
+    // Sub component as its own file: indentation starts from zero and ids, that are file scoped, are
+    // renamed in the order of appearance. Hence the same structure gets the same code wherever it is used.
+    static QByteArray componentStreamCode(const QByteArray& code) {
+        auto lines = code.split('\n');
+        auto indent = std::numeric_limits<qsizetype>::max();
+        for(const auto& line : std::as_const(lines)) {
+            const auto first = std::find_if(line.begin(), line.end(), [](char c) {return c != ' ';});
+            if(first != line.end())
+                indent = std::min<qsizetype>(indent, first - line.begin());
+        }
+        if(indent != std::numeric_limits<qsizetype>::max()) {
+            for(auto& line : lines)
+                line.remove(0, indent);
+        }
+        const auto text = QString::fromUtf8(lines.join('\n'));
+        const auto tokens = identifiers(text);
+        const auto token = [&text](const auto& t) {return QStringView(text).mid(t.first, t.second - t.first);};
+        QHash<QString, QString> ids;
+        for(size_t i = 0; i + 1 < tokens.size(); ++i) {
+            // "id" ":" identifier
+            if(token(tokens[i]) != QLatin1String("id")
+                || QStringView(text).mid(tokens[i].second, tokens[i + 1].first - tokens[i].second).trimmed() != QLatin1String(":"))
+                continue;
+            const auto id = token(tokens[i + 1]).toString();
+            if(!ids.contains(id))
+                ids.insert(id, QString("%1s%2").arg(ID_PREFIX).arg(ids.size()));
+        }
+        if(ids.isEmpty())
+            return text.toUtf8();
+        QString out;
+        out.reserve(text.size());
+        qsizetype pos = 0;
+        for(const auto& t : tokens) {
+            const auto found = ids.constFind(token(t).toString());
+            if(found == ids.constEnd())
+                continue;
+            out += QStringView(text).mid(pos, t.first - pos);
+            out += *found;
+            pos = t.second;
+        }
+        out += QStringView(text).mid(pos);
+        return out.toUtf8();
+    }
+
+    // Code compared for sharing, the level comments tell only where the code was made
+    static QByteArray componentStreamKey(const QByteArray& code) {
+        auto lines = code.split('\n');
+        lines.removeIf([](const QByteArray& line) {
+            const auto trimmed = line.trimmed();
+            return trimmed.startsWith("// component (") && trimmed.contains(") level: ");
+        });
+        return lines.join('\n');
+    }
 
     QByteArray FigmaParser::addComponentStream(const QJsonObject& obj,  const QByteArray& child_item) {
         QByteArray filename;
+        const auto code = componentStreamCode(child_item);
+        const auto key = componentStreamKey(code);
         //const auto is_component_declaration = m_componentLevel != 0;
-        for(;;) {
-            filename = makeFileName(obj, "component").toLatin1();
+        for(int variant = 0;; ++variant) {
+            filename = makeFileName(obj, "component", key, variant).toLatin1();
             /*if(is_component_declaration) {
                 const auto fname = m_data.qmlTargetDir() + filename + ".qml";
                 if(QFile::exists(fname)) {
@@ -2446,12 +2712,10 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             const auto it = m_componentStreams.find(filename);
             if(it == m_componentStreams.end())
                 break;  // not found
-            const auto& current_data = std::get<QByteArray>(*it);
-            const auto& current_obj = std::get<QJsonObject>(*it);
-            if(current_data.length() == child_item.length() && obj == current_obj && qChecksum(child_item) == qChecksum(current_data)) {
-                break; // equal
+            if(componentStreamKey(std::get<QByteArray>(*it)) == key) {
+                break; // structurally equal, shared
             }
         };
-        m_componentStreams.insert(filename, std::make_tuple(obj, child_item)); // what to do for std::move ?
+        m_componentStreams.insert(filename, std::make_tuple(obj, code)); // what to do for std::move ?
         return filename + ".qml";
     }
@@ -6,6 +6,7 @@
 #include "utils.h"
 #include "appwrite.h"
 #include <QVersionNumber>
+#include <QCryptographicHash>
 #include <QTimer>
 #include <QSaveFile>
 #include <QSize>
@@ -15,6 +16,13 @@
 #include <QFontInfo>
 #include <QStandardPaths>
 #include <QFileInfo>
+#include <QThread>
+#include <algorithm>
+#ifndef NO_CONCURRENT
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <numeric>
+#endif
 #ifdef USE_NATIVE_FONT_DIALOG
 #include <QFontDialog>
 #include <QApplication>
@@ -23,7 +31,7 @@
 
 #include <QTime>
 #define TIMED_START(s)  const auto s = QTime::currentTime();
-#define TIMED_END(s, p) if(m_flags & Timed ) {emit info(toStr("timed", p, s.msecsTo(QTime::currentTime())));}
+#define TIMED_END(s, p) if(m_params.flags & Timed ) {emit info(toStr("timed", p, s.msecsTo(QTime::currentTime())));}
 
 #define SCAT(a, b) a ## b
 #define SCAT2(a, b) SCAT(a, b)
@@ -32,6 +40,7 @@
 using namespace std::chrono_literals;
 
 const QLatin1String qmlViewPath("/qml/");
+const QLatin1String qmlNextViewPath("/qml_next/"); // view is generated here when the one in qmlViewPath is shown
 //why there were two folders? onst QLatin1String sourceViewPath("/sources/");
 const QLatin1String Images("/images/");
 const QLatin1String FileHeader("//Generated by FigmaQML %1\n\n");
@@ -65,6 +74,7 @@ enum Format {
 };
 
 FigmaQml::~FigmaQml() {
+    stopGeneration();
 }
 
 int FigmaQml::canvasCount() const {
@@ -145,6 +155,8 @@ bool FigmaQml::saveAllQML(const QString& folderName) {
 #else
     QDir d(folderName);
 #endif
+    if(!isGenerated())
+        return false;
     if(!ensureDirExists(d.absolutePath())) {
         return false;
     }
@@ -213,7 +225,7 @@ QByteArray FigmaQml::sourceCode() const {
 }
 
 FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvider& provider, QObject *parent) : QObject(parent),
-    m_qmlDir(qmlDir), mProvider(provider), m_imports(defaultImports()), m_fontCache(std::make_unique<FontCache>()), m_fontFolder(fontFolder),
+    m_qmlDir(qmlDir), m_targetDir(qmlDir + qmlViewPath), mProvider(provider), m_imports(defaultImports()), m_fontCache(std::make_unique<FontCache>()), m_fontFolder(fontFolder),
     m_fontInfo{ new FontInfo{this} } {
     qmlRegisterUncreatableType<FigmaQml>("FigmaQml", 1, 0, "FigmaQml", "");
     QObject::connect(this, &FigmaQml::currentElementChanged, this, [this]() {
@@ -266,9 +278,12 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
 
     QObject::connect(this, QOverload<FigmaFileDocument*>::of(&FigmaQml::figmaDocumentCreated), this, [this](FigmaFileDocument* doc) {
         Q_ASSERT(doc->type() == FigmaFileDocument::type());
-        Q_ASSERT(!m_uiDoc);
         if(doc) {
-            m_uiDoc.reset(doc);
+            const auto previousDir = m_uiDoc ? m_uiDoc->directory() : QString();
+            m_uiDoc.reset(doc); // replaces the previous view at once
+            // the previous view is not shown anymore, its files can go
+            if(!previousDir.isEmpty() && previousDir != doc->directory())
+                removeViewDir(previousDir);
             emit isValidChanged();
             emit canvasCountChanged();
             emit elementCountChanged();
@@ -291,7 +306,6 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
 
     QObject::connect(this, QOverload<FigmaDataDocument*>::of(&FigmaQml::figmaDocumentCreated), this, [this](FigmaDataDocument* doc) {
         Q_ASSERT(doc->type() == FigmaDataDocument::type());
-        Q_ASSERT(!m_sourceDoc);
         if(doc) {
             m_sourceDoc.reset(doc);
             emit sourceCodeChanged();
@@ -303,6 +317,10 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
 
     QObject::connect(this, &FigmaQml::flagsChanged, this, &FigmaQml::updateDefaultImports);
 
+    QObject::connect(&mProvider, &FigmaProvider::imageReady, this, &FigmaQml::imageArrived);
+    QObject::connect(&mProvider, &FigmaProvider::renderingReady, this, &FigmaQml::imageArrived);
+    QObject::connect(&mProvider, &FigmaProvider::imageFailed, this, &FigmaQml::imageFailed);
+
     QObject::connect(this, &FigmaQml::fontFolderChanged, this, fontFolderChanged);
     fontFolderChanged();
 
@@ -318,6 +336,11 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
 }
 
 void FigmaQml::applyExternalLoaders() {
+    // a background pass writes the same files and loaders it has found are not applied yet, hence it waits the pass
+    if(m_generating) {
+        update([this]() {applyExternalLoaders();});
+        return;
+    }
     for(const auto& [bytes, name] :externalLoaders()) {
         if( m_flags & FigmaQml::LoaderPlaceHolders) {
             emit externalLoadersApplied(name, "qrc:///LoaderPlaceHolder.qml");
@@ -589,42 +612,354 @@ void FigmaQml::setFonts(const QVariantMap& map) {
   }
 }
 
-template<class FigmaDocType>
-void FigmaQml::createDocument(const QJsonObject& json) {
-    m_state = State::Suspend;
+// Requests everything the document is going to need in one go, components first as they may
+// refer more images. Returns number of items still to wait, if something cannot be resolved
+// it is left for the generation to report.
+int FigmaQml::requestDependencies(const QJsonObject& json) {
+    int pending = 0;
+    const auto request = [this, &pending](const QString& id, const auto& isCached, const auto& get, bool wait = true) {
+        if(isCached(id) || m_requested.contains(id)) // requested, but not arrived - error is reported upon generation
+            return;
+        m_requested.insert(id);
+        get(id);
+        if(wait)
+            ++pending;
+    };
+
+    const auto& index = documentIndex(json);
+    const auto missing = FigmaParser::missingComponents(json, index);
+    for(const auto& id : missing) {
+        request(id,
+                [this](const auto& id) {return mProvider.cachedNode(id).has_value();},
+                [this](const auto& id) {mProvider.getNode(id);});
+    }
+    if(pending > 0)
+        return pending;
+
+    const auto tree = documentTree(json);
+    if(!tree)
+        return 0; // error is reported upon generation
+
+    // only the components that the selected elements use
+    FigmaParser::Dependencies dependencies;
+    const auto& components = tree->components();
+    for(const auto& id : requiredComponents(*tree))
+        dependencies += FigmaParser::dependencies(components[id]->object(), m_params.flags | FigmaParser::ParseComponent, *this, *tree);
+
+    int currentCanvas = 0;
+    for(const auto& c : tree->canvases()) {
+        ++currentCanvas;
+        int currentElement = 0;
+        for(const auto& f : c.elements()) {
+            ++currentElement;
+            if(isSelected(currentCanvas, currentElement))
+                dependencies += FigmaParser::dependencies(f, m_params.flags, *this, *tree);
+        }
+    }
+
+    for(const auto& ref : std::as_const(dependencies.images)) {
+        if(!m_embedImages && m_imageFiles.contains(ref))
+            continue;
+        request(ref,
+                [this](const auto& ref) {return mProvider.cachedImage(ref).has_value();},
+                [this](const auto& ref) {mProvider.getImage(ref, QSize(m_params.imageDimensionMax, m_params.imageDimensionMax));},
+                !m_progressive); // progressive generation does not wait images
+    }
+
+    for(const auto& id : std::as_const(dependencies.renderings)) {
+        if(!m_embedImages && m_imageFiles.contains(id))
+            continue;
+        request(id,
+                [this](const auto& id) {return mProvider.cachedRendering(id).has_value();},
+                [this](const auto& id) {mProvider.getRendering(id);},
+                !m_progressive);
+    }
+
+    // fonts are resolved here so that the parser jobs find them from the cache
+    for(const auto& font : std::as_const(dependencies.fonts))
+        fontInfo(font);
+    return pending;
+}
+
+// sources and, if requested, the view are created from the same generation
+void FigmaQml::createDocument(const QJsonObject& json, bool withView, int firstCanvas, int firstElement) {
+    stopGeneration();
+    ++m_revision;
+    m_pending.clear();
+    m_pass.clear();
+    m_patching = false;
+    dropPlaceholders();
+    // the worker reads a copy, the values can be changed while it runs
+    m_params = {m_flags, makeHeader(), m_filter, m_imageDimensionMax, std::make_shared<FontCache>()};
+    for(const auto& [requested, resolved] : m_fontCache->content())
+        m_params.fonts->insert(requested, resolved);
+    m_progressive = withView && (m_params.flags & ProgressiveImages);
+    // view is generated lazily, the element shown first and then the rest on the background (see generatePending),
+    // a filter is a selection already
+    if(withView && m_params.filter.isEmpty())
+        m_pass.insert(firstCanvas + 1, {firstElement + 1});
     m_busy = true;
     emit busyChanged();
+    struct Created {
+        std::unique_ptr<FigmaDataDocument> sourceDoc;
+        std::unique_ptr<FigmaFileDocument> viewDoc;
+    };
+    const auto created = std::make_shared<Created>();
+    runGeneration(json, [this, json, withView, created]() {
+        created->sourceDoc = std::make_unique<FigmaDataDocument>(qmlTargetDir(), FigmaParser::name(json));
+        created->viewDoc = withView ? std::make_unique<FigmaFileDocument>(qmlTargetDir(), FigmaParser::name(json)) : nullptr;
+        Documents docs{created->sourceDoc.get()};
+        if(created->viewDoc)
+            docs.push_back(created->viewDoc.get());
+        return doCreateDocument(docs, json);
+    }, [this, json, withView, created](bool ok) {
+        if(ok) {
+            emit figmaDocumentCreated(created->sourceDoc.release()); // view restore expects sources to be there
+            if(created->viewDoc)
+                emit figmaDocumentCreated(created->viewDoc.release());
+        } else if(m_state != State::Suspend) {
+            if(withView && m_uiDoc)
+                m_targetDir = m_uiDoc->directory(); // shown view stays
+            parseError(FigmaParser::lastError(), true);
+        }
+        if(m_state != State::Suspend) {
+            m_busy = false;
+            emit busyChanged();
+        }
+        if(ok)
+            generatePending(json);
+        return ok;
+    }, [this, withView]() {
+        if(withView && m_uiDoc)
+            m_targetDir = m_uiDoc->directory();
+        if(withView)
+            emit figmaDocumentCreated(static_cast<FigmaFileDocument*>(nullptr));
+        else
+            emit figmaDocumentCreated(static_cast<FigmaDataDocument*>(nullptr));
+    });
+}
+
+// generate is called in a worker thread when the data it needs is available and apply then in this thread
+// with its result, that is called again as long as it suspends for more data, if it fails failed is called.
+// Generation of a replaced document is dropped.
+void FigmaQml::runGeneration(const QJsonObject& json, const std::function<bool ()>& generate, const std::function<bool (bool)>& apply, const std::function<void ()>& failed) {
+    m_state = State::Suspend;
+    m_requested.clear();
     auto ctimer = new QTimer(this);
-    QObject::connect(ctimer, &QTimer::timeout, this, [ctimer, this, json](){
+    auto done = std::make_shared<bool>(false);
+    const auto revision = m_revision;
+    const auto step = [ctimer, this, json, done, revision, generate, apply, failed](){
+        if(*done || m_generating)
+            return;
+        const auto finish = [ctimer, done]() {
+            *done = true;
+            ctimer->stop();
+            ctimer->deleteLater();
+        };
+        if(revision != m_revision) {
+            finish();
+            return;
+        }
         if(m_state == State::Suspend) {
             if(mProvider.isReady()) {
-                m_state = State::Constructing;
+                TIMED_START(t)
+                const auto pending = requestDependencies(json);
+                if(pending > 0)
+                    return; // all requests are on the way, generate when they are done
+                TIMED_END(t, "Prefetch")
 
-                auto doc = std::make_unique<FigmaDocType>(qmlTargetDir(), FigmaParser::name(json));
-                if(doCreateDocument(*doc, json)) {
-                    ctimer->stop();
-                    ctimer->deleteLater();
-                    Q_ASSERT(FigmaDocType::type() == doc->type());
-                    emit figmaDocumentCreated(doc.release());
-                } else if(m_state != State::Suspend) {
-                    parseError(FigmaParser::lastError(), true);
-                }
-                if(m_state != State::Suspend) {
-                    m_busy = false;
-                    emit busyChanged();
-                }
+                m_state = State::Constructing;
+                const auto result = std::make_shared<bool>(false);
+                m_generating = true;
+                m_worker = QThread::create([generate, result]() {*result = generate();});
+                QObject::connect(m_worker, &QThread::finished, m_worker, &QObject::deleteLater);
+                QObject::connect(m_worker, &QThread::finished, ctimer, [this, revision, result, apply, finish]() {
+                    if(revision != m_revision)
+                        return; // stopped, see stopGeneration
+                    m_generating = false;
+                    applyUpdates();
+                    // fonts the worker resolved are kept, unless mapped meanwhile
+                    if(m_params.fonts) {
+                        for(const auto& [requested, resolved] : m_params.fonts->content()) {
+                            if(!m_fontCache->contains(requested))
+                                m_fontCache->insert(requested, resolved);
+                        }
+                    }
+                    if(apply(*result))
+                        finish();
+                });
+                m_worker->start();
             }
         } else {
-            ctimer->stop();
-            ctimer->deleteLater();
-            emit figmaDocumentCreated(static_cast<FigmaDocType*>(nullptr));
+            finish();
+            failed();
         }
-    });
+    };
+    QObject::connect(ctimer, &QTimer::timeout, this, step);
+    // resume as soon as the data arrives, timer is a fallback
+    QObject::connect(&mProvider, &FigmaProvider::imageReady, ctimer, step, Qt::QueuedConnection);
+    QObject::connect(&mProvider, &FigmaProvider::renderingReady, ctimer, step, Qt::QueuedConnection);
+    QObject::connect(&mProvider, &FigmaProvider::nodeReady, ctimer, step, Qt::QueuedConnection);
     ctimer->start(500);
+    QMetaObject::invokeMethod(ctimer, step, Qt::QueuedConnection); // first step right away, timer is for retries
+}
+
+// worker is cancelled and waited, it does not wait this thread so that is quick, its changes are dropped
+void FigmaQml::stopGeneration() {
+    if(m_worker && m_worker->isRunning()) {
+        m_doCancel = true;
+        m_worker->wait();
+        m_doCancel = false;
+    }
+    m_generating = false;
+    QMutexLocker lock(&m_updateMutex);
+    m_updates.clear();
+}
+
+// the state the view uses is changed only in this thread and not during the generation, but when it is done
+void FigmaQml::update(const std::function<void ()>& f) {
+    if(QThread::currentThread() != thread() || m_generating) {
+        QMutexLocker lock(&m_updateMutex);
+        m_updates.push_back(f);
+    } else
+        f();
+}
+
+// a new document is free to change until it is shown
+void FigmaQml::update(const FigmaDocument* doc, const std::function<void ()>& f) {
+    if(doc == m_uiDoc.get() || doc == m_sourceDoc.get())
+        update(f);
+    else
+        f();
+}
+
+void FigmaQml::applyUpdates() {
+    std::vector<std::function<void ()>> updates;
+    {
+        QMutexLocker lock(&m_updateMutex);
+        updates.swap(m_updates);
+    }
+    for(const auto& f : updates)
+        f();
+}
+
+// elements left out from the first pass are generated on the background, a few at time and the nearest
+// to the current element first, thus the element user selects is next, if not ready already
+void FigmaQml::generatePending(const QJsonObject& json) {
+    m_pass.clear();
+    m_patching = !m_pending.empty();
+    if(!m_patching)
+        return;
+    const auto revision = m_revision;
+    QTimer::singleShot(0, this, [this, json, revision]() { // let the view update in between
+        if(revision != m_revision)
+            return;
+        m_pass = nextPass();
+        runGeneration(json, [this]() {
+            return patchDocument();
+        }, [this, json](bool ok) {
+            if(!ok) {
+                if(m_state != State::Suspend)
+                    parseError(FigmaParser::lastError(), true);
+                return false;
+            }
+            if(isSelected(currentCanvas() + 1, currentElement() + 1))
+                emit sourceCodeChanged(); // current was patched
+            emit componentsChanged();
+            if(!m_externalLoaders.isEmpty())
+                applyExternalLoaders();
+            if(m_pending.empty())
+                saveCodeCache(); // once, the file is written as a whole
+            generatePending(json);
+            return true;
+        }, [this]() {
+            m_pass.clear(); // cancelled or failed, the rest are left as placeholders
+            m_patching = false;
+        });
+    });
+}
+
+QMap<int, QSet<int>> FigmaQml::nextPass() const {
+    const auto canvas = currentCanvas();
+    const auto element = currentElement();
+    std::vector<std::pair<int, int>> pending(m_pending.begin(), m_pending.end());
+    const auto distance = [canvas, element](const std::pair<int, int>& p) {
+        return std::make_pair(std::abs(p.first - canvas), p.first == canvas ? std::abs(p.second - element) : p.second);
+    };
+    std::stable_sort(pending.begin(), pending.end(), [&distance](const auto& a, const auto& b) {
+        return distance(a) < distance(b);
+    });
+    const auto count = std::min(pending.size(), static_cast<size_t>(std::max(1, m_jobs > 0 ? m_jobs : QThread::idealThreadCount())));
+    QMap<int, QSet<int>> pass;
+    for(auto i = 0U; i < count; ++i)
+        pass[pending[i].first + 1].insert(pending[i].second + 1);
+    return pass;
+}
+
+// generates the elements of the current pass into the existing documents, those are updated when it is done
+bool FigmaQml::patchDocument() {
+    if(!m_tree || !m_uiDoc || !m_sourceDoc) {
+        update([this]() {m_pending.clear();}); // nothing to patch anymore
+        return true;
+    }
+    m_ok = true;
+    m_doCancel = false;
+    const auto d = QObject::connect(this, &FigmaQml::cancelled, this,
+                                    &FigmaQml::doCancel, Qt::UniqueConnection);
+    RAII(([d](){QObject::disconnect(d);}));
+
+    TIMED_START(t)
+    const auto& tree = *m_tree;
+    const auto header = m_params.header;
+    // generation key is kept, newly resolved fonts do not change the code that is already generated
+    const Documents docs{m_sourceDoc.get(), m_uiDoc.get()};
+    const auto componentsWritten = writeComponents(docs, tree, header);
+    if(!componentsWritten && m_state != State::Suspend)
+        return false;
+    if(!setDocument(docs, tree, header, true) || !componentsWritten)
+        return false;
+    TIMED_END(t, "Pass")
+    return true;
+}
+
+// exports need all the elements
+bool FigmaQml::isGenerated() const {
+    int awaited;
+    {
+        QMutexLocker lock(&m_imageMutex);
+        awaited = static_cast<int>(m_awaited.size());
+    }
+    if(m_pending.empty() && awaited == 0)
+        return true;
+    emit warning(toStr("Document is not generated yet,", m_pending.size(), "elements and", awaited, "images to go"));
+    return false;
+}
+
+bool FigmaQml::isPending(int canvas_index, int element_index) const {
+    return m_pending.count({canvas_index, element_index}) > 0;
+}
+
+// canvas and element are 1-based, as in filter
+bool FigmaQml::isSelected(int canvas, int element) const {
+    const auto contains = [canvas, element](const QMap<int, QSet<int>>& selection) {
+        return selection.isEmpty() || (selection.contains(canvas) && selection[canvas].contains(element));
+    };
+    return contains(m_params.filter) && contains(m_pass);
 }
 
 QString FigmaQml::qmlTargetDir() const {
-    return m_qmlDir + qmlViewPath;
+    return m_targetDir;
+}
+
+void FigmaQml::removeViewDir(const QString& dirName) {
+    QDir(dirName).removeRecursively();
+    QMutexLocker lock(&m_crcMutex);
+    for(auto it = m_crcs.begin(); it != m_crcs.end();) {
+        if(it.key().startsWith(dirName))
+            it = m_crcs.erase(it);
+        else
+            ++it;
+    }
 }
 
 
@@ -632,26 +967,36 @@ void FigmaQml::createDocumentView(const QByteArray &data, bool restoreView) {
 
     if(mRestore)
         return;
-    const auto json = object(data);
+    stopGeneration(); // before the project is changed
+    const auto json = project(data);
     if(!json)
         return;
 
-    reset(restoreView, true, true, true);
-    m_embedImages = true;
+    const auto restoredCanvas = restoreView ? currentCanvas() : 0;
+    const auto restoredElement = restoreView ? currentElement() : 0;
 
-    const auto restoredCanvas = currentCanvas();
-    const auto restoredElement = currentElement();
+    cleanDir(m_qmlDir);
+    // previous view is shown until the new one replaces it (see figmaDocumentCreated), hence the new
+    // one is written into the other view directory
+    const auto shownDir = m_uiDoc ? m_uiDoc->directory() : QString();
+    m_targetDir = m_qmlDir + (shownDir == m_qmlDir + qmlViewPath ? qmlNextViewPath : qmlViewPath);
+    removeViewDir(m_targetDir);
+    m_imageFiles.clear();
+    m_externalLoaders.clear();
+    if(!restoreView)
+        m_fontCache->clear();
+    // view uses the same files as sources, hence the same image settings
+    m_embedImages = m_flags & EmbedImages;
 
-    mRestore = [this, restoreView, restoredElement, restoredCanvas, data](bool has_doc){
-        if(has_doc)
-             createDocumentSources(data);
+    mRestore = [this, restoreView, restoredElement, restoredCanvas](bool has_doc){
+        Q_UNUSED(has_doc);
         if(restoreView) {
             if(setCurrentCanvas(restoredCanvas))
                 setCurrentElement(restoredElement);
         }
     };
 
-    createDocument<FigmaFileDocument>(*json);
+    createDocument(*json, true, restoredCanvas, restoredElement);
 
     emit isValidChanged();
 }
@@ -672,20 +1017,51 @@ void FigmaQml::resetFontMappings() {
 
 
 void FigmaQml::createDocumentSources(const QByteArray &data) {
-    const auto json = object(data);
+    stopGeneration(); // before the project is changed
+    const auto json = project(data);
     if(!json)
         return;
 
-    m_sourceDoc.reset();
     m_embedImages = m_flags & EmbedImages;
 
-    createDocument<FigmaDataDocument>(*json);
+    createDocument(*json, false);
+
+}
+
+void FigmaQml::setTreeSource(const QByteArray& data) {
+    if(data != m_treeSource) { // QByteArray is shared, so usually this is just a pointer compare
+        m_tree.reset();
+        m_index.reset();
+        m_project.reset();
+        m_treeSource = data;
+    }
+}
 
+// document JSON is parsed once per data, the previous one is released before a new one is parsed
+// so that only one document is in memory at time
+std::optional<QJsonObject> FigmaQml::project(const QByteArray& data) {
+    setTreeSource(data);
+    if(!m_project)
+        m_project = object(data);
+    return m_project;
 }
 
-void FigmaQml::restore(int flags, const QVariantMap& imports) {
+const FigmaIndex& FigmaQml::documentIndex(const QJsonObject& json) {
+    if(m_tree)
+        return m_tree->index();
+    if(!m_index)
+        m_index = FigmaParser::documentIndex(json);
+    return *m_index;
+}
+
+void FigmaQml::restore(int flags, const QVariantMap& imports, const QString& filename) {
     m_flags = flags;
     m_imports = imports;
+    if(!filename.isEmpty()) {
+        const auto cacheFile = CodeCache::cacheFileName(filename);
+        if(!m_codeCache.open(cacheFile))
+            emit warning(toStr("Cannot read code cache", cacheFile));
+    }
 }
 
 void FigmaQml::cleanDir(const QString& dirName) {
@@ -772,29 +1148,66 @@ std::optional<std::tuple<QByteArray, int>> FigmaQml::getImage(const QString& ima
         const auto imageData = mProvider.cachedRendering(imageRef);
         if(imageData)
             return imageData;
-        mProvider.getRendering(imageRef);
+        runInMainThread([this, imageRef]() {mProvider.getRendering(imageRef);});
     } else {
         const auto imageData = mProvider.cachedImage(imageRef);
         if(imageData)
             return imageData;
-        mProvider.getImage(imageRef, QSize(m_imageDimensionMax, m_imageDimensionMax));
+        const QSize size(m_params.imageDimensionMax, m_params.imageDimensionMax);
+        runInMainThread([this, imageRef, size]() {mProvider.getImage(imageRef, size);});
     }
     return std::nullopt;
 }
 
+// set when the current thread has requested data that is not available
+static thread_local bool t_dataMissing = false;
+static thread_local QVector<CodeCache::Image>* t_images = nullptr; // images used by the code generated in this job
+static thread_local QStringList* t_placeholders = nullptr; // images that are placeholders in the code generated in this job
+
 void FigmaQml::suspend() {
+    t_dataMissing = true;
     m_state = State::Suspend;
 }
 
+// provider is not thread safe, requests from the parser jobs are queued to here
+void FigmaQml::runInMainThread(const std::function<void ()>& f) {
+    if(QThread::currentThread() == thread())
+        f();
+    else
+        QMetaObject::invokeMethod(this, f, Qt::QueuedConnection);
+}
+
+// calls f(index) for each index in [0, count), concurrently if available and f has to be thread safe
+template<typename F>
+void FigmaQml::forEachJob(int count, const F& f) {
+#ifndef NO_CONCURRENT
+    if(m_jobs != 1 && count > 1) {
+        QThreadPool pool;
+        if(m_jobs > 0)
+            pool.setMaxThreadCount(m_jobs);
+        std::vector<int> indices(count);
+        std::iota(indices.begin(), indices.end(), 0);
+        QtConcurrent::blockingMap(&pool, indices, [&f](int index) {f(index);});
+        return;
+    }
+#endif
+    for(int i = 0; i < count; ++i)
+        f(i);
+}
+
 QByteArray FigmaQml::imageData(const QString& imageRef, bool isRendering) {
     if(!m_ok || m_doCancel)
         return QByteArray();
     if(imageRef == FigmaParser::PlaceHolder)
         return m_brokenPlaceholder;
     else {
+        if(t_images)
+            t_images->append({imageRef, isRendering});
         if(m_embedImages) {
             const auto imageData = getImage(imageRef, isRendering);
             if(!imageData) {
+                if(m_progressive)
+                    return placeholder(imageRef);
                 suspend();
                 return{};
             }
@@ -805,9 +1218,12 @@ QByteArray FigmaQml::imageData(const QString& imageRef, bool isRendering) {
             const QByteArray mimeString = mime == JPEG ? "jpeg" : "png";
             return "data:image/" + mimeString + ";base64," + bytes.toBase64();
         } else {
+            QMutexLocker lock(&m_imageMutex); // image files are shared between the parser jobs
             if(!m_imageFiles.contains(imageRef)) {
                 const auto imageData = getImage(imageRef, isRendering);
                 if(!imageData) {
+                    if(m_progressive)
+                        return placeholder(imageRef);
                     suspend();
                     return{};
                 }
@@ -820,12 +1236,100 @@ QByteArray FigmaQml::imageData(const QString& imageRef, bool isRendering) {
     }
 }
 
+// progressive generation does not wait for images, there is a placeholder until the image arrives (see imageArrived)
+QByteArray FigmaQml::placeholder(const QString& imageRef) {
+    if(t_placeholders)
+        t_placeholders->append(imageRef);
+    return m_brokenPlaceholder;
+}
+
+void FigmaQml::awaitImages(const QString& id, const QStringList& imageRefs) {
+    QMutexLocker lock(&m_imageMutex);
+    for(const auto& ref : imageRefs)
+        m_awaited[ref].insert(id);
+}
+
+// an image that is a placeholder in the generated code has arrived, elements and components that
+// have it are generated again and the elements that have or use them are patched
+void FigmaQml::imageArrived(const QString& imageRef) {
+    if(m_generating) { // generation uses the caches, this is handled when it is done
+        update([this, imageRef]() {imageArrived(imageRef);});
+        return;
+    }
+    QSet<QString> ids;
+    {
+        QMutexLocker lock(&m_imageMutex);
+        const auto it = m_awaited.find(imageRef);
+        if(it == m_awaited.end())
+            return;
+        ids = *it;
+        m_awaited.erase(it);
+    }
+    auto& cache = m_generated[m_generationKey];
+    for(const auto& id : std::as_const(ids)) {
+        cache.elements.remove(id);
+        if(cache.components.remove(id))
+            m_staleComponents.insert(id);
+    }
+    if(!m_tree)
+        return;
+    int canvasIndex = 0;
+    for(const auto& c : m_tree->canvases()) {
+        int elementIndex = 0;
+        for(const auto& f : c.elements()) {
+            const auto id = f["id"].toString();
+            const auto& closure = m_tree->componentClosure(id);
+            if(ids.contains(id) || std::any_of(closure.begin(), closure.end(), [&ids](const auto& componentId) {return ids.contains(componentId);}))
+                m_pending.insert({canvasIndex, elementIndex});
+            ++elementIndex;
+        }
+        ++canvasIndex;
+    }
+    // if a generation is ongoing, it takes these too
+    if(!m_busy && !m_patching && m_project && m_uiDoc)
+        generatePending(*m_project);
+}
+
+// an awaited image will not arrive, its placeholder (broken image) stays in the code
+void FigmaQml::imageFailed(const QString& imageRef) {
+    if(m_generating) {
+        update([this, imageRef]() {imageFailed(imageRef);});
+        return;
+    }
+    QMutexLocker lock(&m_imageMutex);
+    m_awaited.remove(imageRef);
+}
+
+// code with placeholders is not reused by the next document, images may not arrive anymore
+void FigmaQml::dropPlaceholders() {
+    QMutexLocker lock(&m_imageMutex);
+    for(const auto& ids : std::as_const(m_awaited)) {
+        for(auto& generated : m_generated) {
+            for(const auto& id : ids) {
+                generated.second.elements.remove(id);
+                generated.second.components.remove(id);
+            }
+        }
+    }
+    m_awaited.clear();
+    m_staleComponents.clear();
+}
+
+void FigmaQml::removeQmlFile(const QString& component_name) {
+    const QString qname = qmlTargetDir() + component_name + ".qml";
+    {
+        QMutexLocker lock(&m_crcMutex);
+        m_crcs.remove(qname);
+    }
+    QFile::remove(qname);
+}
+
 QByteArray FigmaQml::nodeData(const QString& id) {
     if(!m_ok || m_doCancel)
         return QByteArray();
     const auto node = mProvider.cachedNode(id);
     if(!node) {
-        mProvider.getNode(id);
+        runInMainThread([this, id]() {mProvider.getNode(id);});
         suspend();
         return {};
     }
@@ -833,12 +1337,13 @@ QByteArray FigmaQml::nodeData(const QString& id) {
 }
 
 QString FigmaQml::fontInfo(const QString& requestedFont) {
-    if(m_flags & KeepFigmaFontName)
+    if(m_params.flags & KeepFigmaFontName)
         return requestedFont;
-    if(m_fontCache->contains(requestedFont))
-        return (*m_fontCache)[requestedFont];
-    const auto value = nearestFontFamily(requestedFont, m_flags & AltFontMatch);
-    m_fontCache->insert(requestedFont, value);
+    auto& fonts = m_params.fonts ? *m_params.fonts : *m_fontCache;
+    if(fonts.contains(requestedFont))
+        return fonts[requestedFont];
+    const auto value = nearestFontFamily(requestedFont, m_params.flags & AltFontMatch);
+    fonts.insert(requestedFont, value);
     return value;
 }
 
@@ -864,41 +1369,100 @@ bool FigmaQml::writeQmlFile(const QString& component_name, const QByteArray& ele
 }
 
 
-bool FigmaQml::writeComponents(FigmaDocument& doc, const FigmaParser::Components& components, const QByteArray& header) {
+bool FigmaQml::writeComponents(const Documents& docs, const FigmaTree& tree, const QByteArray& header) {
     qDebug() << "write componets!";
-    for(const auto& c : components) {
+    const auto& components = tree.components();
+
+    // only components that the selected elements use are parsed, as jobs, in the dependency order
+    // (a component after the ones it uses), that is the same between runs (unlike QHash order)
+    const auto required = requiredComponents(tree);
+    std::vector<std::shared_ptr<FigmaParser::Component>> jobs;
+    for(const auto& id : tree.componentOrder()) {
+        if(required.contains(id))
+            jobs.push_back(components[id]);
+    }
+    if(m_params.flags & Timed)
+        emit info(toStr("timed", "components", jobs.size(), "of", components.size()));
+
+    // ones that were completed before suspend or are unchanged since the previous generation are not generated again
+    auto& cache = m_generated[m_generationKey];
+    std::vector<std::shared_ptr<const FigmaParser::Element>> parsed(jobs.size());
+    std::atomic_bool failed = false;
+    forEachJob(static_cast<int>(jobs.size()), [&](int index) {
+        const auto& id = jobs[index]->id();
+        if(failed || m_doCancel || !m_ok || cached(cache.components, id, tree))
+            return;
+        t_dataMissing = false;
+        if(const auto stored = storedCode(CodeCache::Kind::Component, id, tree)) {
+            parsed[index] = stored;
+            return;
+        }
+        if(t_dataMissing)
+            return;
+        QVector<CodeCache::Image> images;
+        QStringList placeholders;
+        t_images = &images;
+        t_placeholders = &placeholders;
+        const auto component_opt = FigmaParser::component(jobs[index]->object(), m_params.flags, *this, tree);
+        t_images = nullptr;
+        t_placeholders = nullptr;
+        if(t_dataMissing)
+            return;
+        if(component_opt) {
+            parsed[index] = std::make_shared<const FigmaParser::Element>(*component_opt);
+            // code with placeholders is not stored, it is generated again when the images arrive
+            if(placeholders.isEmpty())
+                storeCode(CodeCache::Kind::Component, id, tree, parsed[index], images);
+            else
+                awaitImages(id, placeholders);
+        } else
+            failed = true;
+    });
+    for(auto i = 0U; i < jobs.size(); ++i) {
+        if(parsed[i])
+            cache.components.insert(jobs[i]->id(), {tree.contentHash(jobs[i]->id()), parsed[i]});
+    }
 
-      const auto component_opt = FigmaParser::component(c->object(), m_flags, *this, components);
-      if(!m_ok || m_doCancel || !component_opt)
+    // and then written and merged serially
+    for(auto i = 0U; i < jobs.size(); ++i) {
+      const auto& c = jobs[i];
+      const auto generated = cached(cache.components, c->id(), tree);
+      if(!m_ok || m_doCancel || m_state == State::Suspend || !generated)
           return false;
-      const auto& component = component_opt.value();
+      // written already by an earlier pass (see patchDocument), unless it had image placeholders
+      if(m_staleComponents.remove(c->id()))
+          removeQmlFile(c->name());
+      else if(std::all_of(docs.begin(), docs.end(), [&c](const auto doc) {return doc->containsComponent(c->name());}))
+          continue;
+      const auto& component = *generated;
       if(component.data().isEmpty()) {
           emit error(toStr("Invalid component", component.name()));
           return false;
       }
 
+      const auto& name = components[component.id()]->name();
       const auto images = component.imageContexts();
-      for(const auto& im : images) {
-          if(!m_imageContexts.contains(im))
-              m_imageContexts.insert(im, {});
-          m_imageContexts[im].insert(components[component.id()]->name());
-      }
-
-      doc.addComponent(components[component.id()]->name(),
-              components[component.id()]->object(), header + component.data());
-
-
-      QStringList componentNames;
-      for(const auto& id : component.components()) {
-          Q_ASSERT(components.contains(id)); //just check here
-          const auto compname = components[id]->name();
-          componentNames.append(compname);
+      update([this, images, name]() {
+          for(const auto& im : images)
+              m_imageContexts[im].insert(name);
+      });
+
+      for(auto doc : docs) {
+          const auto& object = components[component.id()]->object();
+          const auto data = header + component.data();
+          update(doc, [doc, name, object, data]() {doc->addComponent(name, object, data);});
       }
 
-      const auto subs = component.subComponents();
-      for(const auto& [sub_name, sub_data] : subs.asKeyValueRange()) {
+      const auto& subs = component.subComponents();
+      auto subNames = subs.keys();
+      std::sort(subNames.begin(), subNames.end());
+      for(const auto& sub_name : subNames) {
+          const auto& sub_data = subs[sub_name];
           const auto data = header + std::get<QByteArray>(sub_data);
-          doc.addComponent(sub_name, std::get<QJsonObject>(sub_data), data);
+          for(auto doc : docs) {
+              const auto& object = std::get<QJsonObject>(sub_data);
+              update(doc, [doc, sub_name, object, data]() {doc->addComponent(sub_name, object, data);});
+          }
           //if(std::get<QString>(sub_data).isEmpty()) {
               if(!writeQmlFile(sub_name, data, header/*, c->name()*/)) {
                   emit error(toStr("Cannot write sub component", sub_name, " for ", component.name()));
@@ -907,7 +1471,8 @@ bool FigmaQml::writeComponents(FigmaDocument& doc, const FigmaParser::Components
           //}
       }
 
-      m_externalLoaders.insert(component.externalLoaders());
+      const auto loaders = component.externalLoaders();
+      update([this, loaders]() {m_externalLoaders.insert(loaders);});
 
 
       if(!writeQmlFile(c->name(), component.data(), header)) {
@@ -920,80 +1485,297 @@ bool FigmaQml::writeComponents(FigmaDocument& doc, const FigmaParser::Components
 }
 
 
-bool FigmaQml::setDocument(FigmaDocument& doc,
-                           const FigmaParser::Canvases& canvases,
-                           const FigmaParser::Components& components,
-                           const QByteArray& header) {
-    int currentCanvas = 0;
-
-    int currentElement = 0;
+// tree is flag independent, hence rebuilt only when the document data changes
+const FigmaTree* FigmaQml::documentTree(const QJsonObject& json) {
+    if(!m_tree) {
+        TIMED_START(t)
+        m_tree = FigmaTree::build(json, m_index ? std::move(*m_index) : FigmaParser::documentIndex(json), *this);
+        m_index.reset();
+        if(!m_tree)
+            return nullptr;
+        TIMED_END(t, "Tree")
+    }
+    return &*m_tree;
+}
 
-    for(const auto& c : canvases) {
+// components of the selected elements (see setFilter and generatePending) and the components they use, all if there is no selection
+QSet<QString> FigmaQml::requiredComponents(const FigmaTree& tree) const {
+    const auto& components = tree.components();
+    QSet<QString> required;
+    int currentCanvas = 0;
+    for(const auto& c : tree.canvases()) {
         ++currentCanvas;
-        currentElement = 0;
-        auto canvas = doc.addCanvas(c.name());
-
-        const auto elements = c.elements();
+        int currentElement = 0;
+        for(const auto& f : c.elements()) {
+            ++currentElement;
+            if(!isSelected(currentCanvas, currentElement))
+                continue;
+            const auto id = f["id"].toString();
+            const auto& closure = tree.componentClosure(id);
+            required.unite(QSet<QString>(closure.begin(), closure.end()));
+            if(components.contains(id))
+                required.insert(id);
+        }
+    }
+    return required;
+}
+
+// names of the given components, their sub components and the sub components of the element,
+// i.e. all the files that the element or component needs
+QStringList FigmaQml::usedComponents(const QStringList& componentIds, const FigmaTree& tree, const QHash<QString, Generated>& cache, const FigmaParser::Element& element) {
+    const auto& components = tree.components();
+    QStringList names;
+    const auto addSubs = [&names](const FigmaParser::Element& e) {
+        const auto& subs = e.subComponents();
+        for(auto it = subs.begin(); it != subs.end(); ++it)
+            names.append(it.key());
+    };
+    for(const auto& id : componentIds) {
+        names.append(components[id]->name());
+        if(const auto generated = cached(cache, id, tree))
+            addSubs(*generated);
+    }
+    addSubs(element);
+    return names;
+}
 
-        qDebug() << "write elements";
+// digest of the parameters that change the generated code, like FigmaTree::contentHash it is
+// a persistent cache key, hence cryptographic
+QByteArray FigmaQml::generationKey(const QByteArray& header) const {
+    QCryptographicHash key(QCryptographicHash::Sha1);
+    const auto add = [&key](const QByteArray& data) {
+        key.addData(QByteArray::number(data.size()) + ':');
+        key.addData(data);
+    };
+    add(QByteArray::number(m_params.flags & ~static_cast<unsigned>(Timed | ProgressiveImages)));
+    add(QByteArray::number(m_embedImages));
+    add(QByteArray::number(m_params.imageDimensionMax));
+    add(header);
+    auto fonts = m_params.fonts->content();
+    std::sort(fonts.begin(), fonts.end());
+    for(const auto& [requested, resolved] : fonts) {
+        add(requested.toUtf8());
+        add(resolved.toUtf8());
+    }
+    return key.result();
+}
+
+std::shared_ptr<const FigmaParser::Element> FigmaQml::cached(const QHash<QString, Generated>& cache, const QString& id, const FigmaTree& tree) {
+    const auto it = cache.find(id);
+    if(it == cache.end() || it->hash != tree.contentHash(id))
+        return nullptr;
+    return it->element;
+}
+
+// code from the earlier sessions, the images it uses are requested as if it was generated
+std::shared_ptr<const FigmaParser::Element> FigmaQml::storedCode(CodeCache::Kind kind, const QString& id, const FigmaTree& tree) {
+    if(!m_codeCache.isOpen())
+        return nullptr;
+    const auto entry = m_codeCache.find(CodeCache::key(kind, id, tree.contentHash(id), m_generationKey));
+    if(!entry)
+        return nullptr;
+    QStringList placeholders;
+    t_placeholders = &placeholders;
+    for(const auto& image : entry->images) {
+        imageData(image.ref, image.isRendering);
+        if(t_dataMissing)
+            break;
+    }
+    t_placeholders = nullptr;
+    if(t_dataMissing)
+        return nullptr;
+    if(!placeholders.isEmpty()) // code is fine, but image files are not there yet
+        awaitImages(id, placeholders);
+    return entry->element;
+}
 
-        for(const auto& f : elements) {
-            if(m_state == State::Suspend)
-                return false;
-            if(m_doCancel)
-                return false;
-            bool hasElement = true;
-            if(!m_filter.isEmpty()) {
-                ++currentElement;
-                const auto keys = m_filter.keys();
-                if(!keys.contains(currentCanvas) || !m_filter[currentCanvas].contains(currentElement))
-                    hasElement = false;
-            }
+void FigmaQml::storeCode(CodeCache::Kind kind, const QString& id, const FigmaTree& tree, const std::shared_ptr<const FigmaParser::Element>& element, const QVector<CodeCache::Image>& images) {
+    if(m_codeCache.isOpen())
+        m_codeCache.insert(CodeCache::key(kind, id, tree.contentHash(id), m_generationKey), {element, images});
+}
 
-            const auto element_opt = hasElement ? FigmaParser::element(f, m_flags, *this, components) : FigmaParser::Element();
-            if(!element_opt)
-                return false;
-            const auto& element = element_opt.value();
+void FigmaQml::saveCodeCache() {
+    if(!m_codeCache.isOpen())
+        return;
+    if(!m_codeCache.save())
+        emit warning("Cannot write code cache");
+    if(m_params.flags & Timed) {
+        const auto stats = m_codeCache.stats();
+        emit info(toStr("timed", "code cache hits", stats.hits, "misses", stats.misses, "evicted", stats.evicted,
+                        "entries", stats.entries, "bytes", stats.size));
+    }
+}
 
-            const auto images = element.imageContexts();
-            for(const auto& im : images) {
-                if(!m_imageContexts.contains(im))
-                    m_imageContexts.insert(im, {});
-                m_imageContexts[im].insert(element.name());
+bool FigmaQml::setDocument(const Documents& docs,
+                           const FigmaTree& tree,
+                           const QByteArray& header,
+                           bool patch) {
+    const auto& canvases = tree.canvases();
+    const auto& components = tree.components();
+
+    // elements are independent, so they are generated as jobs and then merged in the document order,
+    // a patch has only the selected elements that then replace their placeholders
+    struct Job {
+        int canvas;
+        int index;
+        const QJsonObject* element;
+        bool selected;
+    };
+    std::vector<Job> jobs;
+    int currentCanvas = 0;
+    for(const auto& c : canvases) {
+        ++currentCanvas;
+        int currentElement = 0;
+        for(const auto& f : c.elements()) {
+            ++currentElement;
+            const auto selected = isSelected(currentCanvas, currentElement);
+            if(patch && !selected)
+                continue;
+            if(!selected && !m_pass.isEmpty()) {
+                const std::pair<int, int> position(currentCanvas - 1, currentElement - 1);
+                update([this, position]() {m_pending.insert(position);});
             }
-            if(m_state == State::Suspend)
-                return false;
+            jobs.push_back({currentCanvas - 1, currentElement - 1, &f, selected});
+        }
+    }
 
-            if(m_doCancel)
-                return false;
-            if(!m_ok) {
-                return false;
-            }
-            if(!element.data().isEmpty())
-                canvas->addElement(element.name(), header + element.data());
+    qDebug() << "write elements";
+
+    // ones that were completed before suspend or are unchanged since the previous generation are not generated again
+    auto& cache = m_generated[m_generationKey];
+    const auto filtered = std::make_shared<const FigmaParser::Element>();
+    std::vector<std::shared_ptr<const FigmaParser::Element>> elements(jobs.size());
+    std::atomic_bool failed = false;
+    forEachJob(static_cast<int>(jobs.size()), [&](int index) {
+        const auto& job = jobs[index];
+        if(!job.selected) {
+            elements[index] = filtered;
+            return;
+        }
+        const auto id = (*job.element)["id"].toString();
+        if(failed || m_doCancel || !m_ok)
+            return;
+        if(const auto generated = cached(cache.elements, id, tree)) {
+            elements[index] = generated;
+            return;
+        }
+        t_dataMissing = false;
+        if(const auto stored = storedCode(CodeCache::Kind::Element, id, tree)) {
+            elements[index] = stored;
+            return;
+        }
+        if(t_dataMissing)
+            return;
+        QVector<CodeCache::Image> images;
+        QStringList placeholders;
+        t_images = &images;
+        t_placeholders = &placeholders;
+        const auto element_opt = FigmaParser::element(*job.element, m_params.flags, *this, tree);
+        t_images = nullptr;
+        t_placeholders = nullptr;
+        if(t_dataMissing)
+            return;
+        if(element_opt) {
+            elements[index] = std::make_shared<const FigmaParser::Element>(*element_opt);
+            if(placeholders.isEmpty())
+                storeCode(CodeCache::Kind::Element, id, tree, elements[index], images);
             else
-                canvas->addElement(element.name(), header + "Text{text: \"filtered out\"}");
-            QStringList componentNames;
-            for(const auto& id : element.components()) {
-                componentNames.append(components[id]->name());
-            }
+                awaitImages(id, placeholders);
+        } else
+            failed = true;
+    });
+    for(auto i = 0U; i < jobs.size(); ++i) {
+        if(elements[i] && jobs[i].selected) {
+            const auto id = (*jobs[i].element)["id"].toString();
+            cache.elements.insert(id, {tree.contentHash(id), elements[i]});
+        }
+    }
+
+    std::vector<FigmaDocument::Canvas*> docCanvases(docs.size(), nullptr);
+    int canvasIndex = -1;
+    for(auto i = 0U; i < jobs.size(); ++i) {
+        if(m_state == State::Suspend)
+            return false;
+        if(m_doCancel)
+            return false;
+        if(!m_ok) {
+            return false;
+        }
+        if(!elements[i])
+            return false;   // suspended or failed
+
+        const auto& job = jobs[i];
+        while(!patch && canvasIndex < job.canvas) {
+            ++canvasIndex;
+            for(auto d = 0U; d < docs.size(); ++d)
+                docCanvases[d] = docs[d]->addCanvas(canvases[canvasIndex].name());
+        }
+
+        const auto id = (*job.element)["id"].toString();
+        if(!job.selected) {
+            // generated later (see generatePending) or not at all
+            const auto placeholder = header + (m_pass.isEmpty() ? "Text{text: \"filtered out\"}" : "Text{text: \"generating...\"}");
+            for(auto canvas : docCanvases)
+                canvas->addElement(tree.elementName(id), placeholder);
+            continue;
+        }
 
-            m_externalLoaders.insert(element.externalLoaders());
-
-            // this is bit confusing, the component owned sub componets are written before this function is called,
-            // but as element owned has to be called elsewhere it happens here. Whole this when is written and parsed
-            // what is confusing
-            for(const auto& [sub_name, sub_data] : element.subComponents().asKeyValueRange()) {
-                componentNames.append(sub_name);
-                const auto data = header + std::get<QByteArray>(sub_data);
-                doc.addComponent(sub_name, std::get<QJsonObject>(sub_data), data);
-                //if(std::get<QString>(sub_data).isEmpty()) {
-                    if(!writeQmlFile(sub_name, data, header/*, element.name()*/))
-                        return false;
-                //}
+        const auto& element = *elements[i];
+
+        const auto images = element.imageContexts();
+        update([this, images, name = element.name()]() {
+            for(const auto& im : images)
+                m_imageContexts[im].insert(name);
+        });
+
+        const auto elementData = header + element.data();
+        if(patch) {
+            // placeholders are replaced when the pass is done
+            update([this, docs, job, elementData, name = element.name()]() {
+                for(auto doc : docs) {
+                    if(!doc->getCanvas(job.canvas)->setElement(job.index, elementData))
+                        emit error(toStr("Cannot write element", name));
+                }
+                m_pending.erase({job.canvas, job.index});
+            });
+        } else {
+            for(auto canvas : docCanvases)
+                canvas->addElement(element.name(), elementData);
+        }
+        auto componentIds = tree.componentClosure(id);
+        if(components.contains(id)) // element that is a component is its instance
+            componentIds.append(id);
+        const auto componentNames = usedComponents(componentIds, tree, cache.components, element);
+
+        const auto loaders = element.externalLoaders();
+        update([this, loaders]() {m_externalLoaders.insert(loaders);});
+
+        // this is bit confusing, the component owned sub componets are written before this function is called,
+        // but as element owned has to be called elsewhere it happens here. Whole this when is written and parsed
+        // what is confusing
+        const auto& subs = element.subComponents();
+        auto subNames = subs.keys();
+        std::sort(subNames.begin(), subNames.end());
+        for(const auto& sub_name : subNames) {
+            const auto& sub_data = subs[sub_name];
+            const auto data = header + std::get<QByteArray>(sub_data);
+            for(auto doc : docs) {
+                const auto& object = std::get<QJsonObject>(sub_data);
+                update(doc, [doc, sub_name, object, data]() {doc->addComponent(sub_name, object, data);});
             }
-            doc.setComponents(element.name(), std::move(componentNames));
+            //if(std::get<QString>(sub_data).isEmpty()) {
+                if(!writeQmlFile(sub_name, data, header/*, element.name()*/))
+                    return false;
+            //}
         }
+        for(auto doc : docs)
+            update(doc, [doc, name = element.name(), componentNames]() {doc->setComponents(name, componentNames);});
+    }
+    // canvases without elements
+    while(!patch && canvasIndex < static_cast<int>(canvases.size()) - 1) {
+        ++canvasIndex;
+        for(auto doc : docs)
+            doc->addCanvas(canvases[canvasIndex].name());
     }
     return true;
 }
@@ -1031,7 +1813,7 @@ QByteArray FigmaQml::makeHeader() const {
     return header;
 }
 
-bool FigmaQml::doCreateDocument(FigmaDocument& doc, const QJsonObject& json) {
+bool FigmaQml::doCreateDocument(const Documents& docs, const QJsonObject& json) {
     m_ok = true;
     m_doCancel = false; // uff UniqueConnection requires a member func
     const auto d = QObject::connect(this, &FigmaQml::cancelled, this,
@@ -1040,7 +1822,7 @@ bool FigmaQml::doCreateDocument(FigmaDocument& doc, const QJsonObject& json) {
     RAII(([d](){QObject::disconnect(d);}));
 
 
-    Q_ASSERT(m_imageDimensionMax > 0);
+    Q_ASSERT(m_params.imageDimensionMax > 0);
 
     // erase 1st
     QDir dir(qmlTargetDir());
@@ -1050,13 +1832,15 @@ bool FigmaQml::doCreateDocument(FigmaDocument& doc, const QJsonObject& json) {
 
 
 
-    const auto components = FigmaParser::components(json, *this);
-
-    if(!components) {
+    const auto treePtr = documentTree(json);
+    if(!treePtr)
         return false;
-    }
+    const auto& tree = *treePtr;
 
      TIMED_START(t3)
+    const auto parsedNodes = FigmaParser::parsedNodes();
+    const auto arenaAllocations = ParserArena::allocations();
+    const auto heapAllocations = ParserArena::heapAllocations();
 
     /*
     const auto keys = components->keys();
@@ -1075,9 +1859,22 @@ bool FigmaQml::doCreateDocument(FigmaDocument& doc, const QJsonObject& json) {
     qDebug() << "loopers" << loopers << i << r << n;
     */
 
-     const auto header = makeHeader();
+     const auto header = m_params.header;
 
-    if(!writeComponents(doc, *components, header)) {
+    // results are kept per generation parameters, when they change it is a full generation, but
+    // the previous ones are kept (view and sources are generated alternately)
+    const auto key = generationKey(header);
+    for(auto it = m_generated.begin(); it != m_generated.end();) {
+        if(it->first != key && it->first != m_generationKey)
+            it = m_generated.erase(it);
+        else
+            ++it;
+    }
+    m_generationKey = key;
+
+    // when suspended, elements are still generated to get as much done as possible before retry
+    const auto componentsWritten = writeComponents(docs, tree, header);
+    if(!componentsWritten && m_state != State::Suspend) {
         return false;
     }
 
@@ -1085,15 +1882,22 @@ bool FigmaQml::doCreateDocument(FigmaDocument& doc, const QJsonObject& json) {
     TIMED_START(t4)
 
 
-    const auto canvases = FigmaParser::canvases(json);
-    if(!canvases)
-        return false;
-
-    if(!setDocument(doc, *canvases, *components, header)) {
+    if(!setDocument(docs, tree, header) || !componentsWritten) {
         return false;
     }
 
     TIMED_END(t4, "elements")
+    if(m_params.flags & Timed) {
+        // per node cost of generation (cached items are not parsed, hence not counted)
+        const auto nodes = FigmaParser::parsedNodes() - parsedNodes;
+        const auto us = t3.msecsTo(QTime::currentTime()) * 1000.;
+        emit info(toStr("timed", "nodes", nodes, "per node us", nodes > 0 ? us / nodes : 0.));
+        // parser scratch containers only, served from the arenas vs. blocks they took from the heap,
+        // QString and QByteArray payloads in them are allocated as before and not counted
+        emit info(toStr("timed", "arena container allocations", ParserArena::allocations() - arenaAllocations,
+                        "arena heap blocks", ParserArena::heapAllocations() - heapAllocations));
+    }
+    saveCodeCache();
     return true;
 }
 
@@ -1114,6 +1918,8 @@ void FigmaQml::showFontDialog(const QString& currentFont) {
 
 
 void FigmaQml::executeQul(const QVariantMap& parameters, const QVector<int>& elements) {
+    if(!isGenerated())
+        return;
 #if defined(HAS_QUL) && defined(HAS_EXECUTE)
     AppWrite::executeQulApp(parameters, *this, elements);
 #else
@@ -1123,6 +1929,8 @@ void FigmaQml::executeQul(const QVariantMap& parameters, const QVector<int>& ele
 }
 
 void FigmaQml::executeApp(const QVariantMap& parameters, const QVector<int>& elements) {
+    if(!isGenerated())
+        return;
 #ifdef HAS_EXECUTE
     AppWrite::executeApp(parameters, *this, elements);
 #else
@@ -1141,6 +1949,8 @@ QStringList FigmaQml::supportedQulHardware() const {
 }
 
 bool FigmaQml::saveQML(bool isMcu, const QString& folderName, bool writeAsApp, const QVector<int>& elements) {
+    if(!isGenerated())
+        return false;
     if(isMcu) {
     #ifdef HAS_QUL
         return  AppWrite::writeQul(folderName, *this, writeAsApp, elements);
@@ -1198,7 +2008,9 @@ std::optional<QString> FigmaQml::uniqueFilename(const QString& filename_proposal
     assert(data.size() > 1);
     const auto data_crc = qChecksum(data);
     auto filename = filename_proposal;
-    for(;;) {
+    QMutexLocker lock(&m_crcMutex); // files are written from the worker and this thread
+    // a different content gets a name derived from its checksum, hence names do not depend on the request order
+    for(int variant = 0;; ++variant) {
         const auto it = m_crcs.find(filename);
         if(it == m_crcs.end())
             break;
@@ -1206,8 +2018,9 @@ std::optional<QString> FigmaQml::uniqueFilename(const QString& filename_proposal
             assert(QFile::exists(filename));
             return std::nullopt; // CRC match its ok, but exists
         }
-        const QFileInfo info(filename);
-        filename = QFileInfo(info.path(), info.baseName() + QString::number(unique_number()) + "." + info.completeSuffix()).filePath();
+        const QFileInfo info(filename_proposal);
+        const auto suffix = QString::number(data_crc, 16) + (variant > 0 ? '_' + QString::number(variant) : QString());
+        filename = QFileInfo(info.path(), info.baseName() + '_' + suffix + "." + info.completeSuffix()).filePath();
     }
     assert(!QFile::exists(filename));
     m_crcs.insert(filename, data_crc);
@@ -1217,20 +2030,19 @@ std::optional<QString> FigmaQml::uniqueFilename(const QString& filename_proposal
 bool FigmaQml::testFileExists(const QString& filename, const QByteArray& data) const {
     if(!QFile::exists(filename))
         return false;
+    QMutexLocker lock(&m_crcMutex);
     qDebug() << "File exists" << filename << "known:" << m_crcs.contains(filename) << "is same:" << (qChecksum(data) == checksum(filename)) << "is read:" << (m_crcs.contains(filename) ? (qChecksum(data) == m_crcs[filename] ? "Yes" : "No") : "N/A");
     return true;
 }
 
-unsigned FigmaQml::unique_number() {
-    ++m_unique_number;
-    return m_unique_number;
-}
-
 Q_INVOKABLE void FigmaQml::reset(bool keepFonts, bool keepSources, bool keepImages, bool keepFetch) {
+    stopGeneration();
     cleanDir(m_qmlDir);
     m_imageFiles.clear();
     m_externalLoaders.clear();
     m_uiDoc.reset();
+    m_pending.clear();
+    ++m_revision; // ongoing generation has no document to complete
     if(!keepSources) {
         m_sourceDoc.reset();
         m_externalLoaders.clear();
@@ -1240,6 +2052,7 @@ Q_INVOKABLE void FigmaQml::reset(bool keepFonts, bool keepSources, bool keepImag
 
     if(!keepImages) {
         m_imageFiles.clear();
+        QMutexLocker lock(&m_crcMutex);
         m_crcs.clear();
         m_imageContexts.clear();
     }
@@ -1248,7 +2061,12 @@ Q_INVOKABLE void FigmaQml::reset(bool keepFonts, bool keepSources, bool keepImag
         m_imports = defaultImports();
         m_filter.clear();
         QDir(m_qmlDir).removeRecursively();
-        m_unique_number = 1;
+        m_tree.reset();
+        m_index.reset();
+        m_project.reset();
+        m_treeSource.clear();
+        m_generated.clear();
+        m_codeCache.close();
         mProvider.reset();
     }
 
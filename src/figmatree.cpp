@@ -0,0 +1,289 @@
+#include "figmatree.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QCryptographicHash>
+#include <algorithm>
+
+std::optional<FigmaTree> FigmaTree::build(const QJsonObject& project, FigmaIndex&& index, FigmaParserData& data) {
+    FigmaTree tree(FigmaParser::name(project), std::move(index));
+    auto components = FigmaParser::components(project, tree.m_index, data, tree.m_names);
+    if(!components)
+        return std::nullopt;
+    auto canvases = FigmaParser::canvases(project);
+    if(!canvases)
+        return std::nullopt;
+    tree.m_components = std::move(*components);
+    tree.m_canvases = std::move(*canvases);
+
+    for(const auto& canvas : tree.m_canvases) {
+        for(const auto& element : canvas.elements())
+            tree.m_names.add(element["id"].toString(), element["name"].toString());
+    }
+    // components that are in the document are already there, fetched ones are not
+    for(const auto& c : std::as_const(tree.m_components))
+        tree.m_index.add(c->object());
+
+    tree.m_nodes.resize(static_cast<size_t>(tree.m_index.size()));
+    tree.makeHashes();
+
+    for(const auto& c : std::as_const(tree.m_components)) {
+        for(const auto instance : tree.m_index.instances(c->id()))
+            tree.resolveInstance(instance);
+    }
+
+    tree.makeDependencies();
+
+    QSet<QString> visiting;
+    for(const auto& c : std::as_const(tree.m_components))
+        tree.makeContentHash(c->id(), visiting);
+    for(const auto& canvas : tree.m_canvases) {
+        for(const auto& element : canvas.elements())
+            tree.makeContentHash(element["id"].toString(), visiting);
+    }
+    return tree;
+}
+
+FigmaTree::FigmaTree(const QString& name, FigmaIndex&& index) :
+    m_name(name), m_index(std::move(index)) {}
+
+// subtree hash is node's own properties combined with its children hashes,
+// index is in pre-order so going backwards children are always done before their parent
+void FigmaTree::makeHashes() {
+    for(auto i = m_index.size() - 1; i >= 0; --i) {
+        const auto& entry = m_index.at(i);
+        size_t hash = 0;
+        size_t properties = 0;
+        for(auto it = entry.object.begin(); it != entry.object.end(); ++it) {
+            if(it.key() == QLatin1String("children"))
+                continue;
+            const auto valueHash = qHash(it.value());
+            hash = qHashMulti(hash, it.key(), valueHash);
+            if(!isVarying(it.key()))
+                properties = qHashMulti(properties, it.key(), valueHash);
+        }
+        for(const auto child : entry.children)
+            hash = qHashMulti(hash, m_nodes[static_cast<size_t>(child)].hash);
+        m_nodes[static_cast<size_t>(i)].hash = hash;
+        m_nodes[static_cast<size_t>(i)].properties = properties;
+    }
+}
+
+// keys that are (almost) always different between instances of a component, compared per instance,
+// the rest is compared once per distinct set of values
+bool FigmaTree::isVarying(const QString& key) {
+    static const QSet<QString> keys{"id", "name", "children", "absoluteBoundingBox", "absoluteRenderBounds", "relativeTransform"};
+    return keys.contains(key);
+}
+
+// non-varying properties are the same
+bool FigmaTree::sameProperties(const QJsonObject& a, const QJsonObject& b) {
+    qsizetype count = 0;
+    for(auto it = a.begin(); it != a.end(); ++it) {
+        if(isVarying(it.key()))
+            continue;
+        const auto other = b.constFind(it.key());
+        if(other == b.constEnd() || *other != it.value())
+            return false;
+        ++count;
+    }
+    for(auto it = b.begin(); it != b.end(); ++it) {
+        if(!isVarying(it.key()))
+            --count;
+    }
+    return count == 0;
+}
+
+size_t FigmaTree::childrenHash(int index) const {
+    size_t hash = 0;
+    for(const auto child : m_index.at(index).children)
+        hash = qHashMulti(hash, m_nodes[static_cast<size_t>(child)].hash);
+    return hash;
+}
+
+// Properties of instance that are not in base or have a different value, the name is
+// kept in a non-empty delta if not ignored. Subtrees (children) with different hashes differ,
+// equal hashes are confirmed by comparing the subtrees.
+QJsonObject FigmaTree::delta(int instance, int base, const QSet<QString>& ignored) {
+    const auto& object = m_index.at(instance).object;
+    const auto& baseObject = m_index.at(base).object;
+    const auto key = std::make_pair(base, m_nodes[static_cast<size_t>(instance)].properties);
+    // hash is not unique, hence the properties of a memo are compared before it is used
+    QJsonObject newObject;
+    const auto [begin, end] = m_deltas.equal_range(key);
+    const auto memo = std::find_if(begin, end, [&object](const Delta& d) {return sameProperties(d.instance, object);});
+    if(memo != end) {
+        newObject = memo->delta;
+    } else {
+        for(auto it = object.begin(); it != object.end(); ++it) {
+            if(isVarying(it.key()))
+                continue;
+            const auto b = baseObject.constFind(it.key());
+            if(b == baseObject.constEnd() || *b != it.value())
+                newObject.insert(it.key(), it.value());
+        }
+        m_deltas.insert(key, {object, newObject});
+    }
+    for(const auto& k : ignored)
+        newObject.remove(k);
+    for(auto it = object.begin(); it != object.end(); ++it) {
+        if(!isVarying(it.key()) || ignored.contains(it.key()))
+            continue;
+        const auto b = baseObject.constFind(it.key());
+        if(b == baseObject.constEnd())
+            newObject.insert(it.key(), it.value());
+        else if((it.key() == QLatin1String("children") && childrenHash(instance) != childrenHash(base)) || *b != it.value())
+            newObject.insert(it.key(), it.value());
+    }
+    //These items get wiped off, but are needed later - so we put them back
+    if(!newObject.isEmpty()) {
+        if(!ignored.contains("name") && object.contains("name"))
+            newObject.insert("name", object["name"]);
+    }
+    return newObject;
+}
+
+void FigmaTree::collectComponentIds(int index, QSet<QString>& ids) const {
+    const auto& entry = m_index.at(index);
+    if(entry.type == QLatin1String("INSTANCE"))
+        ids.insert(entry.object["componentId"].toString());
+    else if(entry.type == QLatin1String("COMPONENT")) // nested component is generated as its instance
+        ids.insert(entry.object["id"].toString());
+    for(const auto child : entry.children)
+        collectComponentIds(child, ids);
+}
+
+// components used in the subtree, the node itself excluded
+QStringList FigmaTree::directDependencies(int index) const {
+    QSet<QString> ids;
+    for(const auto child : m_index.at(index).children)
+        collectComponentIds(child, ids);
+    QStringList dependencies;
+    for(const auto& id : std::as_const(ids)) {
+        if(m_components.contains(id))
+            dependencies.append(id);
+    }
+    dependencies.sort();
+    return dependencies;
+}
+
+void FigmaTree::orderComponent(const QString& id, QSet<QString>& visited) {
+    if(visited.contains(id))
+        return; // done, or a cycle that Figma should not let to exist
+    visited.insert(id);
+    for(const auto& dependency : m_dependencies.value(id))
+        orderComponent(dependency, visited);
+    m_componentOrder.append(id);
+}
+
+// component dependency graph is built once, then its topological order and the closure of each
+// component and element so that exports of a selection does not need to walk the graph again
+void FigmaTree::makeDependencies() {
+    QStringList elementIds;
+    for(const auto& canvas : m_canvases) {
+        for(const auto& element : canvas.elements())
+            elementIds.append(element["id"].toString());
+    }
+    for(const auto& id : m_components.keys() + elementIds) {
+        if(const auto index = m_index.indexOf(id); index >= 0 && !m_dependencies.contains(id))
+            m_dependencies.insert(id, directDependencies(index));
+    }
+
+    auto componentIds = m_components.keys();
+    std::sort(componentIds.begin(), componentIds.end(), [this](const auto& a, const auto& b) {
+        const auto& na = m_components[a]->name();
+        const auto& nb = m_components[b]->name();
+        return na == nb ? a < b : na < nb;
+    });
+    QSet<QString> visited;
+    for(const auto& id : std::as_const(componentIds))
+        orderComponent(id, visited);
+
+    // dependencies are ordered before, hence their closures are ready
+    const auto makeClosure = [this](const QString& id) {
+        QSet<QString> closure;
+        for(const auto& dependency : m_dependencies.value(id)) {
+            closure.insert(dependency);
+            for(const auto& indirect : m_closures.value(dependency))
+                closure.insert(indirect);
+        }
+        closure.remove(id);
+        QStringList ids(closure.begin(), closure.end());
+        ids.sort();
+        m_closures.insert(id, ids);
+    };
+    for(const auto& id : std::as_const(m_componentOrder))
+        makeClosure(id);
+    for(const auto& id : std::as_const(elementIds)) {
+        if(!m_closures.contains(id))
+            makeClosure(id);
+    }
+}
+
+const QStringList& FigmaTree::componentClosure(const QString& id) const {
+    static const QStringList empty;
+    const auto it = m_closures.find(id);
+    return it == m_closures.end() ? empty : *it;
+}
+
+// digest of all that the generated code of an element or component depends on: its subtree, names
+// and the components it uses (and what they use). It is cryptographic, as equal digests are taken as
+// equal code without comparing the content, in this session and the later ones (see CodeCache).
+QByteArray FigmaTree::makeContentHash(const QString& id, QSet<QString>& visiting) {
+    if(const auto it = m_contentHashes.find(id); it != m_contentHashes.end())
+        return *it;
+    const auto index = m_index.indexOf(id);
+    if(index < 0)
+        return QByteArray();
+    visiting.insert(id);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const auto add = [&hash](const QByteArray& data) { // length prefixed, hence fields cannot shift
+        hash.addData(QByteArray::number(data.size()) + ':');
+        hash.addData(data);
+    };
+    add(QJsonDocument(m_index.at(index).object).toJson(QJsonDocument::Compact));
+    add(m_names.name(id).toUtf8());
+    for(const auto& componentId : m_dependencies.value(id)) {
+        if(visiting.contains(componentId))
+            continue;
+        add(componentId.toUtf8());
+        add(m_components[componentId]->name().toUtf8());
+        add(makeContentHash(componentId, visiting));
+    }
+    visiting.remove(id);
+    const auto digest = hash.result();
+    m_contentHashes.insert(id, digest);
+    return digest;
+}
+
+// This is the flag independent part of FigmaParser::parseInstance and makeInstanceChildren
+void FigmaTree::resolveInstance(int index) {
+    const auto& entry = m_index.at(index);
+    const auto componentId = entry.object["componentId"].toString();
+    const auto compIndex = m_index.indexOf(componentId);
+    Q_ASSERT(compIndex >= 0);
+    auto& node = m_nodes[static_cast<size_t>(index)];
+    node.componentId = componentId;
+    node.instanceDelta = delta(index, compIndex, {"children"});
+
+    const auto& compChildren = m_index.at(compIndex).children;
+    if(compChildren.size() != entry.children.size()
+            || entry.children.size() != entry.object["children"].toArray().size())
+        return;
+    // instance children ids are in form of "I<instance>;<component child>"
+    QHash<QStringView, int> childPositions;
+    childPositions.reserve(entry.children.size());
+    for(int i = 0; i < entry.children.size(); ++i) {
+        const auto& childId = m_index.at(entry.children[i]).id;
+        childPositions.insert(QStringView(childId).mid(childId.lastIndexOf(';') + 1), i);
+    }
+    for(const auto cc : compChildren) {
+        const auto childIndex = childPositions.value(QStringView(m_index.at(cc).id), -1);
+        node.childIndices.append(childIndex);
+        if(childIndex < 0) {
+            node.childDeltas.append(QJsonObject());
+            continue;
+        }
+        //Then we compare to to find delta, we ignore absoluteBoundingBox as size and transformations are aliases
+        node.childDeltas.append(delta(entry.children[childIndex], cc, {"absoluteBoundingBox", "name", "id"}));
+    }
+}
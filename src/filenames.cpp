@@ -0,0 +1,19 @@
+#include "filenames.h"
+#include "figmaparser.h"
+
+QString FileNames::add(const QString& id, const QString& itemName) {
+    if(const auto it = m_names.find(id); it != m_names.end())
+        return *it;
+    if(itemName.isEmpty())
+        return QString();
+    // equal names are numbered, a numbered name may collide with an other item name, hence the loop
+    auto& count = m_counts[itemName];
+    QString name;
+    do {
+        name = FigmaParser::makeFileName(itemName + (count > 0 ? QString::number(count) : QString()) + FIGMA_SUFFIX);
+        ++count;
+    } while(m_used.contains(name));
+    m_used.insert(name);
+    m_names.insert(id, name);
+    return name;
+}
@@ -0,0 +1,148 @@
+#include "jsonscanner.h"
+#include <algorithm>
+
+qsizetype JsonScanner::skipSpace(Value data, qsizetype pos) {
+    while(pos < data.size() && (data[pos] == ' ' || data[pos] == '\n' || data[pos] == '\r' || data[pos] == '\t'))
+        ++pos;
+    return pos;
+}
+
+// returns position after the closing quote, -1 if not terminated
+qsizetype JsonScanner::skipString(Value data, qsizetype pos) {
+    Q_ASSERT(data[pos] == '"');
+    for(++pos; pos < data.size(); ++pos) {
+        if(data[pos] == '\\')
+            ++pos;
+        else if(data[pos] == '"')
+            return pos + 1;
+    }
+    return -1;
+}
+
+// returns position after the value, -1 if invalid
+qsizetype JsonScanner::skipValue(Value data, qsizetype pos) {
+    if(pos >= data.size())
+        return -1;
+    const auto c = data[pos];
+    if(c == '"')
+        return skipString(data, pos);
+    if(c == '{' || c == '[') {
+        int depth = 0;
+        while(pos < data.size()) {
+            const auto d = data[pos];
+            if(d == '"') {
+                pos = skipString(data, pos);
+                if(pos < 0)
+                    return -1;
+                continue;
+            }
+            if(d == '{' || d == '[') {
+                ++depth;
+            } else if(d == '}' || d == ']') {
+                if(--depth == 0)
+                    return pos + 1;
+            }
+            ++pos;
+        }
+        return -1;
+    }
+    // number, true, false or null
+    const auto begin = pos;
+    while(pos < data.size() && data[pos] != ',' && data[pos] != '}' && data[pos] != ']'
+          && data[pos] != ' ' && data[pos] != '\n' && data[pos] != '\r' && data[pos] != '\t')
+        ++pos;
+    return pos > begin ? pos : -1;
+}
+
+bool JsonScanner::forEachMember(Value object, const std::function<bool (Value key, Value value)>& f) {
+    if(!isObject(object))
+        return false;
+    auto pos = skipSpace(object, 1);
+    if(pos < object.size() && object[pos] == '}')
+        return true;
+    while(pos < object.size()) {
+        if(object[pos] != '"')
+            return false;
+        const auto keyEnd = skipString(object, pos);
+        if(keyEnd < 0)
+            return false;
+        const auto key = object.sliced(pos + 1, keyEnd - pos - 2);
+        pos = skipSpace(object, keyEnd);
+        if(pos >= object.size() || object[pos] != ':')
+            return false;
+        const auto valueBegin = skipSpace(object, pos + 1);
+        const auto valueEnd = skipValue(object, valueBegin);
+        if(valueEnd < 0)
+            return false;
+        if(!f(key, object.sliced(valueBegin, valueEnd - valueBegin)))
+            return true;
+        pos = skipSpace(object, valueEnd);
+        if(pos < object.size() && object[pos] == '}')
+            return true;
+        if(pos >= object.size() || object[pos] != ',')
+            return false;
+        pos = skipSpace(object, pos + 1);
+    }
+    return false;
+}
+
+std::optional<JsonScanner::Value> JsonScanner::find(std::initializer_list<QByteArrayView> path) const {
+    const Value data(m_data);
+    // root is not skipped over as a whole, members are scanned only until the key is found
+    auto current = data.sliced(skipSpace(data, 0));
+    for(const auto& key : path) {
+        std::optional<Value> found;
+        const auto ok = forEachMember(current, [&key, &found](Value k, Value v) {
+            if(k != key)
+                return true;
+            found = v;
+            return false;
+        });
+        if(!ok || !found)
+            return std::nullopt;
+        current = *found;
+    }
+    return current;
+}
+
+QString JsonScanner::toString(Value value) {
+    if(!isString(value))
+        return QString();
+    const auto raw = value.sliced(1, value.size() - 2);
+    if(std::find(raw.begin(), raw.end(), '\\') == raw.end())
+        return QString::fromUtf8(raw);
+    QByteArray bytes;
+    bytes.reserve(raw.size());
+    QString out;
+    const auto flush = [&bytes, &out]() {
+        out += QString::fromUtf8(bytes);
+        bytes.clear();
+    };
+    for(qsizetype i = 0; i < raw.size(); ++i) {
+        if(raw[i] != '\\' || i + 1 >= raw.size()) {
+            bytes += raw[i];
+            continue;
+        }
+        const auto c = raw[++i];
+        switch(c) {
+        case 'b': bytes += '\b'; break;
+        case 'f': bytes += '\f'; break;
+        case 'n': bytes += '\n'; break;
+        case 'r': bytes += '\r'; break;
+        case 't': bytes += '\t'; break;
+        case 'u':
+            if(i + 4 < raw.size()) {
+                flush();
+                bool ok = false;
+                const auto code = raw.sliced(i + 1, 4).toByteArray().toUShort(&ok, 16);
+                if(ok)
+                    out += QChar(code); // surrogate pairs come as two consecutive escapes
+                i += 4;
+            }
+            break;
+        default: bytes += c; break; // '"', '\\' and '/'
+        }
+    }
+    flush();
+    return out;
+}
@@ -114,9 +114,12 @@ int main(int argc, char *argv[]) {
     const QCommandLineOption showParameter("show", "Set current page and view to <page index>-<view index>, indexing starts from 1.", "show");
     const QCommandLineOption altFontMatchParameter("alt-font-match", "Use alternative font matching algorithm.");
     const QCommandLineOption fontMapParameter("font-map", "Provide a ';' separated list of <figma font>':'<system font> pairs.", "fontMap");
-    const QCommandLineOption throttleParameter("throttle", "Milliseconds between server requests. Too frequent request may have issues, especially with big desings - default 300", "throttle");
+    const QCommandLineOption throttleParameter("throttle", "Milliseconds server requests are collected before they are sent, renderings are requested in bunches - default 300", "throttle");
+    const QCommandLineOption apiRequestsParameter("api-requests", "Maximum number of concurrent requests to the Figma API - default 4", "apiRequests");
+    const QCommandLineOption imageRequestsParameter("image-requests", "Maximum number of concurrent image downloads - default 8", "imageRequests");
     const QCommandLineOption qulmodeParameter("qul-mode", "QtQuick for Qt for MCU");
     const QCommandLineOption staticCodeParameter("static-code", "Do not generate any dynamic, interactive code, property access, event handlers etc.");
+    const QCommandLineOption jobsParameter("jobs", "Number of parallel code generation jobs, 1 for serial - default 0 that uses all cores. Requires QT6_CONCURRENT build.", "jobs");
 
     parser.addPositionalArgument("argument 1", "Optional: .figmaqml file or user token. GUI opened if empty.", "<FIGMAQML_FILE>|<USER_TOKEN>");
     parser.addPositionalArgument("argument 2", "Optional: Output directory name (or .figmaqml file name if '--store' is given), assuming the first parameter was the restored file. If empty, GUI is opened. Project token is expected if the first parameter was an user token.", "<OUTPUT if FIGMAQML_FILE>| PROJECT_TOKEN if USER_TOKEN");
@@ -138,8 +141,11 @@ int main(int argc, char *argv[]) {
                           altFontMatchParameter,
                           fontMapParameter,
                           throttleParameter,
+                          apiRequestsParameter,
+                          imageRequestsParameter,
                           figmaFontParameter,
                           staticCodeParameter,
+                          jobsParameter,
 #ifdef HAS_QUL
                           qulmodeParameter,
 #endif
@@ -308,6 +314,15 @@ int main(int argc, char *argv[]) {
 
          if(parser.isSet(throttleParameter))
             figmaGet->setProperty("throttle", parser.value(throttleParameter));
+
+         if(parser.isSet(apiRequestsParameter))
+            figmaGet->setProperty("apiRequests", parser.value(apiRequestsParameter));
+
+         if(parser.isSet(imageRequestsParameter))
+            figmaGet->setProperty("imageRequests", parser.value(imageRequestsParameter));
+
+         if(parser.isSet(jobsParameter))
+            figmaQml->setProperty("jobs", parser.value(jobsParameter));
      }
 
 
@@ -387,9 +402,9 @@ int main(int argc, char *argv[]) {
 
          if(!restore.isEmpty()) {
              QObject::connect(figmaGet.get(), &FigmaGet::restored,
-                              figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports) {
+                              figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports, const QString& filename) {
 
-                 figmaQml->restore(flags, imports);
+                 figmaQml->restore(flags, imports, filename);
                  figmaQml->createDocumentSources(figmaGet->data());
              });
          } else {
@@ -448,8 +463,8 @@ int main(int argc, char *argv[]) {
          });
 
          QObject::connect(figmaGet.get(), &FigmaGet::restored,
-                          figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports) {
-             figmaQml->restore(flags, imports);
+                          figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports, const QString& filename) {
+             figmaQml->restore(flags, imports, filename);
              figmaQml->createDocumentView(figmaGet->data(), false);
          });
 
@@ -480,15 +495,16 @@ int main(int argc, char *argv[]) {
          });
 
          QObject::connect(figmaQml.get(), &FigmaQml::componentLoaded, [&figmaQml, &canvas, &element, &snapFile](int currentCanvas, int currentElement) {
-             if(currentCanvas == canvas - 1 && currentElement == element - 1) {
+             // a placeholder is loaded until the element is generated
+             if(currentCanvas == canvas - 1 && currentElement == element - 1 && !figmaQml->isPending(currentCanvas, currentElement)) {
                  emit figmaQml->takeSnap(snapFile, canvas - 1, element - 1);
              }
          });
 
          if(!restore.isEmpty()) {
              QObject::connect(figmaGet.get(), &FigmaGet::restored,
-                              figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports) {
-                  figmaQml->restore(flags, imports);
+                              figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports, const QString& filename) {
+                  figmaQml->restore(flags, imports, filename);
                   figmaQml->createDocumentView(figmaGet->data(), false);
              });
          } else {
@@ -0,0 +1,67 @@
+#include "ratelimiter.h"
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cmath>
+
+constexpr auto MinRateDivisor = 32.0;       // rate is not halved below the nominal rate divided by this
+constexpr auto RampUpSteps = 10.0;          // successful requests to ramp up from zero to the nominal rate
+constexpr qint64 BaseDelay = 1000;          // first back off if the server does not tell, ms
+constexpr qint64 MaxDelay = 60 * 1000;      // figma doc says about one minute
+
+RateLimiter::RateLimiter(double rate, double burst) :
+    m_nominalRate(std::max(0.01, rate)),
+    m_burst(std::max(1.0, burst)),
+    m_rate(m_nominalRate),
+    m_tokens(m_burst),
+    m_refilled(Clock::now()),
+    m_blockedUntil(m_refilled) {}
+
+void RateLimiter::refill(Clock::time_point now) {
+    const std::chrono::duration<double> elapsed = now - m_refilled;
+    m_tokens = std::min(m_burst, m_tokens + elapsed.count() * m_rate);
+    m_refilled = now;
+}
+
+qint64 RateLimiter::acquire() {
+    const auto now = Clock::now();
+    refill(now);
+    if(now < m_blockedUntil)
+        return std::max<qint64>(1, std::chrono::duration_cast<std::chrono::milliseconds>(m_blockedUntil - now).count());
+    if(m_tokens < 1.0)
+        return std::max<qint64>(1, static_cast<qint64>(std::ceil((1.0 - m_tokens) / m_rate * 1000.0)));
+    m_tokens -= 1.0;
+    return 0;
+}
+
+void RateLimiter::refund() {
+    m_tokens = std::min(m_burst, m_tokens + 1.0);
+}
+
+void RateLimiter::backOff(std::optional<qint64> retryAfter) {
+    const auto now = Clock::now();
+    refill(now);
+    m_rate = std::max(m_nominalRate / MinRateDivisor, m_rate / 2.0);
+    m_tokens = 0;
+    // the time server asks and a bit, otherwise exponential of which the latter half is random
+    qint64 delay;
+    if(retryAfter) {
+        delay = std::max<qint64>(0, *retryAfter) + QRandomGenerator::global()->bounded(BaseDelay);
+    } else {
+        const auto exponential = std::min(MaxDelay, BaseDelay << std::min(m_failures, 6U));
+        delay = exponential / 2 + QRandomGenerator::global()->bounded(exponential / 2 + 1);
+    }
+    ++m_failures;
+    m_blockedUntil = std::max(m_blockedUntil, now + std::chrono::milliseconds(delay));
+}
+
+void RateLimiter::succeeded(std::optional<int> remaining, std::optional<qint64> reset) {
+    const auto now = Clock::now();
+    refill(now);
+    m_failures = 0;
+    m_rate = std::min(m_nominalRate, m_rate + m_nominalRate / RampUpSteps);
+    if(remaining) {
+        m_tokens = std::min(m_tokens, static_cast<double>(std::max(0, *remaining)));
+        if(*remaining <= 0 && reset)
+            m_blockedUntil = std::max(m_blockedUntil, now + std::chrono::milliseconds(*reset));
+    }
+}
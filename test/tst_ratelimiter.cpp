@@ -0,0 +1,100 @@
+#include "ratelimiter.h"
+#include <QTest>
+
+class TestRateLimiter : public QObject {
+    Q_OBJECT
+private slots:
+    void burst();
+    void refill();
+    void refund();
+    void backOffRetryAfter();
+    void backOffExponential();
+    void backOffHalvesRate();
+    void rampUp();
+    void rateLimitHeaders();
+};
+
+void TestRateLimiter::burst() {
+    RateLimiter limiter(1.0, 3.0);
+    QCOMPARE(limiter.acquire(), qint64(0));
+    QCOMPARE(limiter.acquire(), qint64(0));
+    QCOMPARE(limiter.acquire(), qint64(0));
+    const auto wait = limiter.acquire();
+    QVERIFY(wait > 0 && wait <= 1000);
+}
+
+void TestRateLimiter::refill() {
+    RateLimiter limiter(20.0, 1.0);
+    QCOMPARE(limiter.acquire(), qint64(0));
+    const auto wait = limiter.acquire();
+    QVERIFY(wait > 0 && wait <= 50);
+    QTest::qSleep(static_cast<int>(wait) + 20);
+    QCOMPARE(limiter.acquire(), qint64(0));
+}
+
+void TestRateLimiter::refund() {
+    RateLimiter limiter(1.0, 1.0);
+    QCOMPARE(limiter.acquire(), qint64(0));
+    limiter.refund();
+    QCOMPARE(limiter.acquire(), qint64(0));
+    QVERIFY(limiter.acquire() > 0);
+}
+
+void TestRateLimiter::backOffRetryAfter() {
+    // the time server asks and up to a second of jitter
+    RateLimiter limiter(10.0, 5.0);
+    limiter.backOff(300);
+    const auto wait = limiter.acquire();
+    QVERIFY(wait >= 250 && wait <= 1300);
+}
+
+void TestRateLimiter::backOffExponential() {
+    // first delay is between a half and a whole second, then doubles
+    RateLimiter limiter(10.0, 5.0);
+    limiter.backOff(std::nullopt);
+    const auto first = limiter.acquire();
+    QVERIFY(first >= 450 && first <= 1000);
+    limiter.backOff(std::nullopt);
+    const auto second = limiter.acquire();
+    QVERIFY(second >= 950 && second <= 2000);
+}
+
+void TestRateLimiter::backOffHalvesRate() {
+    RateLimiter limiter(8.0, 5.0);
+    limiter.backOff(0);
+    QCOMPARE(limiter.rate(), 4.0);
+    limiter.backOff(0);
+    QCOMPARE(limiter.rate(), 2.0);
+    for(int i = 0; i < 10; ++i)
+        limiter.backOff(0);
+    QCOMPARE(limiter.rate(), 8.0 / 32.0);
+}
+
+void TestRateLimiter::rampUp() {
+    // a tenth of the nominal rate per success, up to the nominal rate
+    RateLimiter limiter(10.0, 5.0);
+    limiter.backOff(0);
+    QCOMPARE(limiter.rate(), 5.0);
+    limiter.succeeded();
+    QCOMPARE(limiter.rate(), 6.0);
+    for(int i = 0; i < 4; ++i)
+        limiter.succeeded();
+    QCOMPARE(limiter.rate(), 10.0);
+    limiter.succeeded();
+    QCOMPARE(limiter.rate(), 10.0);
+}
+
+void TestRateLimiter::rateLimitHeaders() {
+    RateLimiter remaining(10.0, 5.0);
+    remaining.succeeded(1);
+    QCOMPARE(remaining.acquire(), qint64(0));
+    QVERIFY(remaining.acquire() > 0);
+
+    RateLimiter exhausted(10.0, 5.0);
+    exhausted.succeeded(0, 500);
+    const auto wait = exhausted.acquire();
+    QVERIFY(wait >= 450 && wait <= 500);
+}
+
+QTEST_APPLESS_MAIN(TestRateLimiter)
+#include "tst_ratelimiter.moc"